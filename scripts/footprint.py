@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""ROM / RAM footprint report of the firmware ELF, failing if a budget is exceeded.
+
+ROM is the size of everything loaded from flash (code, read-only data and the initial values of
+initialized data), RAM the size of all writable sections (data, bss, noinit, stacks). The largest
+symbols of each region are listed, so growth can be attributed.
+
+Usage: footprint.py <zephyr.elf> --rom-budget <bytes> --ram-budget <bytes> [--top N] [--out FILE]
+"""
+
+import argparse
+import struct
+import sys
+
+PT_LOAD = 1
+PF_W = 0x2
+SHT_SYMTAB = 2
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+STT_OBJECT = 1
+STT_FUNC = 2
+
+
+class Elf:
+    def __init__(self, data):
+        if data[:4] != b"\x7fELF":
+            raise ValueError("not an ELF file")
+        self.data = data
+        self.is64 = data[4] == 2
+        self.endian = "<" if data[5] == 1 else ">"
+        if self.is64:
+            fields = struct.unpack_from(self.endian + "QQQIHHHHHH", data, 24)
+        else:
+            fields = struct.unpack_from(self.endian + "IIIIHHHHHH", data, 24)
+        (_, self.phoff, self.shoff, _, _, self.phentsize, self.phnum, self.shentsize, self.shnum,
+         self.shstrndx) = fields
+
+    def segments(self):
+        for i in range(self.phnum):
+            offset = self.phoff + i * self.phentsize
+            if self.is64:
+                p_type, p_flags, _, _, _, filesz, memsz, _ = struct.unpack_from(
+                    self.endian + "IIQQQQQQ", self.data, offset)
+            else:
+                p_type, _, _, _, filesz, memsz, p_flags, _ = struct.unpack_from(
+                    self.endian + "IIIIIIII", self.data, offset)
+            yield p_type, p_flags, filesz, memsz
+
+    def sections(self):
+        for i in range(self.shnum):
+            offset = self.shoff + i * self.shentsize
+            if self.is64:
+                name, sh_type, flags, _, sh_offset, size, link, _, _, entsize = \
+                    struct.unpack_from(self.endian + "IIQQQQIIQQ", self.data, offset)
+            else:
+                name, sh_type, flags, _, sh_offset, size, link, _, _, entsize = \
+                    struct.unpack_from(self.endian + "IIIIIIIIII", self.data, offset)
+            yield {"name": name, "type": sh_type, "flags": flags, "offset": sh_offset,
+                   "size": size, "link": link, "entsize": entsize}
+
+    def string(self, table, index):
+        start = table["offset"] + index
+        return self.data[start:self.data.index(b"\0", start)].decode(errors="replace")
+
+    def symbols(self):
+        sections = list(self.sections())
+        for symtab in (s for s in sections if s["type"] == SHT_SYMTAB):
+            strtab = sections[symtab["link"]]
+            for offset in range(symtab["offset"], symtab["offset"] + symtab["size"],
+                                symtab["entsize"]):
+                if self.is64:
+                    name, info, _, shndx, _, size = struct.unpack_from(
+                        self.endian + "IBBHQQ", self.data, offset)
+                else:
+                    name, _, size, info, _, shndx = struct.unpack_from(
+                        self.endian + "IIIBBH", self.data, offset)
+                if info & 0xF not in (STT_OBJECT, STT_FUNC) or not size or \
+                        shndx == 0 or shndx >= len(sections):
+                    continue
+                flags = sections[shndx]["flags"]
+                if flags & SHF_ALLOC:
+                    yield self.string(strtab, name), size, bool(flags & SHF_WRITE)
+
+
+def percent(used, budget):
+    return 100.0 * used / budget if budget else 0.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf")
+    parser.add_argument("--rom-budget", type=int, required=True)
+    parser.add_argument("--ram-budget", type=int, required=True)
+    parser.add_argument("--top", type=int, default=10, help="largest symbols listed per region")
+    parser.add_argument("--out", help="also write the report to this file")
+    args = parser.parse_args()
+
+    with open(args.elf, "rb") as f:
+        elf = Elf(f.read())
+
+    rom = ram = 0
+    for p_type, p_flags, filesz, memsz in elf.segments():
+        if p_type != PT_LOAD:
+            continue
+        rom += filesz
+        if p_flags & PF_W:
+            ram += memsz
+
+    symbols = list(elf.symbols())
+    lines = [
+        f"{'region':<8}{'used':>10}{'budget':>10}{'usage':>9}",
+        f"{'ROM':<8}{rom:>10}{args.rom_budget:>10}{percent(rom, args.rom_budget):>8.1f}%",
+        f"{'RAM':<8}{ram:>10}{args.ram_budget:>10}{percent(ram, args.ram_budget):>8.1f}%",
+    ]
+    for region, writable in (("ROM", False), ("RAM", True)):
+        lines.append("")
+        lines.append(f"largest {region} symbols:")
+        largest = sorted((s for s in symbols if s[2] == writable), key=lambda s: -s[1])
+        lines.extend(f"  {size:>8}  {name}" for name, size, _ in largest[:args.top])
+
+    failed = []
+    if rom > args.rom_budget:
+        failed.append(f"ROM budget exceeded by {rom - args.rom_budget} bytes")
+    if ram > args.ram_budget:
+        failed.append(f"RAM budget exceeded by {ram - args.ram_budget} bytes")
+    lines.append("")
+    lines.extend(failed or ["footprint within budget"])
+
+    report = "\n".join(lines) + "\n"
+    sys.stdout.write(report)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(report)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Stack sizes of release.conf from the high-water marks of a stacks.conf build.
+
+Reads the output of the `kernel stacks` shell command and prints a release.conf line for each
+configurable stack: the high-water mark plus MARGIN_PERCENT (at least MARGIN_MIN bytes), rounded
+up to ALIGN bytes, with the measured numbers in the comment. Only the stacks sized in release.conf
+are considered, all others are listed as skipped.
+
+Usage: stack_sizes.py <kernel stacks output>
+"""
+
+import argparse
+import re
+import sys
+
+MARGIN_PERCENT = 25
+MARGIN_MIN = 256
+ALIGN = 64
+
+# thread name (or prefix) reported by `kernel stacks` -> Kconfig option of its size
+STACKS = [
+    ("app_work_q", "CONFIG_APP_WORK_Q_STACK_SIZE"),
+    ("sysworkq", "CONFIG_SYSTEM_WORKQUEUE_STACK_SIZE"),
+    ("BT RX", "CONFIG_BT_RX_STACK_SIZE"),
+    ("IRQ 00", "CONFIG_ISR_STACK_SIZE"),
+]
+
+# e.g. "0x20001a28 app_work_q (real size 4096):	unused 3372	usage 724 / 4096 (17 %)"
+LINE = re.compile(r"(?:0x[0-9a-f]+\s+)?(.+?)\s+\(real size (\d+)\):\s+unused\s+(\d+)\s+"
+                  r"usage\s+(\d+)\s*/\s*(\d+)")
+
+
+def size_for(used):
+    size = used + max(used * MARGIN_PERCENT // 100, MARGIN_MIN)
+    return -(-size // ALIGN) * ALIGN
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", help="saved output of the `kernel stacks` shell command")
+    args = parser.parse_args()
+
+    measured = {}
+    with open(args.output, errors="replace") as f:
+        for line in f:
+            m = LINE.search(line)
+            if not m:
+                continue
+            name, used, size = m.group(1).strip(), int(m.group(4)), int(m.group(5))
+            option = next((o for prefix, o in STACKS if name.startswith(prefix)), None)
+            if option is None:
+                print(f"# skipped {name}: {used} of {size} bytes used", file=sys.stderr)
+                continue
+            if used == size:
+                sys.exit(f"{name} used its whole stack, measure with larger stacks")
+            measured[option] = max(measured.get(option, 0), used)
+
+    missing = [o for _, o in STACKS if o not in measured]
+    if missing:
+        sys.exit(f"no high-water mark for {', '.join(missing)}")
+    for _, option in STACKS:
+        used = measured[option]
+        print(f"{option}={size_for(used)} # high-water mark {used} bytes + "
+              f"{MARGIN_PERCENT}% (at least {MARGIN_MIN} bytes)")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Sample-to-air latency report of a CTF trace recorded with the tracing.conf profile.
+
+A cycle starts with the last sensor read of a measurement interval (sample trace point) and ends
+with the first advertising event carrying its payload (adv_event). In between, the payload is
+encoded (encode), passed to the controller (adv_update / adv_start) and becomes the active buffer
+(swap), see src/trace.h. Cycles whose measurements did not change are never encoded and skipped.
+For every stage, the latency distribution is reported together with the number of ISRs and thread
+switches that interleaved with the cycles.
+
+Requires the babeltrace2 python bindings (bt2), like $ZEPHYR_BASE/scripts/tracing/parse_ctf.py.
+The trace directory must contain the CTF stream and the metadata file of the Zephyr tree.
+
+Usage: trace_latency.py <trace dir> [--sla-ms MS] [--out FILE]
+"""
+
+import argparse
+import sys
+
+try:
+    import bt2
+except ImportError:
+    sys.exit("babeltrace2 python bindings (bt2) are required")
+
+# (label, start point, end point) of each reported stage
+STAGES = [
+    ("sample -> encode", "sample", "encode"),
+    ("encode -> controller", "encode", "controller"),
+    ("controller -> swap", "controller", "swap"),
+    ("swap -> air", "swap", "air"),
+    ("sample -> air", "sample", "air"),
+]
+
+
+def field_str(field):
+    # bounded strings are decoded as strings or as arrays of characters, depending on bt2
+    if isinstance(field, str) or isinstance(field, bt2._StringFieldConst):
+        return str(field).rstrip("\0")
+    return "".join(chr(c) for c in field if c).strip()
+
+
+def signed32(value):
+    return value - (1 << 32) if value & (1 << 31) else value
+
+
+def events(trace_dir):
+    for msg in bt2.TraceCollectionMessageIterator(trace_dir):
+        if type(msg) is bt2._EventMessageConst:
+            yield msg.default_clock_snapshot.ns_from_origin, msg.event
+
+
+def collect(trace_dir):
+    cycles = []
+    # last sensor read, waiting for its payload to be encoded
+    current = None
+    # encoded payloads by sequence number, waiting for their first advertising event
+    pending = {}
+
+    for ns, event in events(trace_dir):
+        if event.name in ("isr_enter", "thread_switched_in"):
+            key = "isrs" if event.name == "isr_enter" else "switches"
+            for cycle in ([current] if current else []) + list(pending.values()):
+                cycle[key] += 1
+            continue
+        if event.name != "named_event":
+            continue
+
+        name = field_str(event.payload_field["name"])
+        arg0 = int(event.payload_field["arg0"])
+        arg1 = int(event.payload_field["arg1"])
+        if name == "sample" and arg0 + 1 == arg1:
+            # an unchanged cycle is replaced by the next one
+            current = {"sample": ns, "isrs": 0, "switches": 0}
+        elif name == "encode" and current:
+            current["encode"] = ns
+            pending[arg0] = current
+            current = None
+        elif name in ("adv_update", "adv_start") and arg0 in pending:
+            if signed32(arg1) == 0:
+                pending[arg0].setdefault("controller", ns)
+        elif name == "swap" and arg0 in pending:
+            pending[arg0]["swap"] = ns
+        elif name == "adv_event" and arg0 in pending:
+            cycle = pending.pop(arg0)
+            cycle["air"] = ns
+            cycles.append(cycle)
+    return cycles, len(pending)
+
+
+def percentile(values, p):
+    # nearest rank
+    return values[max(0, -(-len(values) * p // 100) - 1)]
+
+
+def report(cycles, incomplete):
+    lines = [f"{len(cycles)} cycles, {incomplete} without advertising event", "",
+             f"{'stage [ms]':<22}{'min':>9}{'p50':>9}{'p95':>9}{'p99':>9}{'max':>9}"]
+    for label, start, end in STAGES:
+        values = sorted((c[end] - c[start]) / 1e6 for c in cycles if start in c and end in c)
+        if not values:
+            lines.append(f"{label:<22}{'-':>9}")
+            continue
+        lines.append(f"{label:<22}{values[0]:>9.2f}" +
+                     "".join(f"{percentile(values, p):>9.2f}" for p in (50, 95, 99)) +
+                     f"{values[-1]:>9.2f}")
+    lines.append("")
+    for key, label in (("isrs", "ISRs"), ("switches", "thread switches")):
+        counts = [c[key] for c in cycles]
+        lines.append(f"{label} per cycle: avg {sum(counts) / len(counts):.1f}, max {max(counts)}")
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace_dir")
+    parser.add_argument("--sla-ms", type=float,
+                        help="fail if a cycle takes longer from sample to air")
+    parser.add_argument("--out", help="also write the report to this file")
+    args = parser.parse_args()
+
+    cycles, incomplete = collect(args.trace_dir)
+    if not cycles:
+        sys.exit("no complete cycles in the trace")
+
+    lines = report(cycles, incomplete)
+    failed = 0
+    if args.sla_ms is not None:
+        failed = sum(1 for c in cycles if (c["air"] - c["sample"]) / 1e6 > args.sla_ms)
+        lines.append("")
+        lines.append(f"{failed} cycles exceed the {args.sla_ms}ms SLA" if failed
+                     else f"all cycles within the {args.sla_ms}ms SLA")
+
+    report_text = "\n".join(lines) + "\n"
+    sys.stdout.write(report_text)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(report_text)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,211 @@
+#include "adv_crypto.h"
+
+LOG_MODULE_REGISTER(adv_crypto);
+
+#define AES_BLOCK_LEN 16
+// nonce layout: MAC, format, zero padding, big endian message counter
+#define NONCE_OFFSET_FORMAT  RUUVI_MAC_LEN
+#define NONCE_OFFSET_COUNTER (AES_BLOCK_LEN - 4)
+
+BUILD_ASSERT(RUUVI_F8_CIPHER_LEN <= AES_BLOCK_LEN, "payload must fit into a single block");
+
+// only accessed from the application work queue (and init)
+static psa_key_id_t key_id = PSA_KEY_ID_NULL;
+static uint8_t mac[RUUVI_MAC_LEN];
+static uint32_t counter;
+static uint8_t keystream[AES_BLOCK_LEN];
+static bool keystream_ready;
+
+// key written by the shell, imported on the application work queue
+static uint8_t new_key[ADV_CRYPTO_KEY_LEN];
+
+static void prepare_work_handler(struct k_work *work);
+static void key_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(prepare_work, prepare_work_handler);
+static K_WORK_DEFINE(key_work, key_work_handler);
+
+static int import_key(const uint8_t *key)
+{
+	psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+
+	if (key_id != PSA_KEY_ID_NULL) {
+		psa_destroy_key(key_id);
+		key_id = PSA_KEY_ID_NULL;
+	}
+	keystream_ready = false;
+
+	psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_ENCRYPT);
+	psa_set_key_lifetime(&attributes, PSA_KEY_LIFETIME_VOLATILE);
+	psa_set_key_algorithm(&attributes, PSA_ALG_ECB_NO_PADDING);
+	psa_set_key_type(&attributes, PSA_KEY_TYPE_AES);
+	psa_set_key_bits(&attributes, ADV_CRYPTO_KEY_LEN * 8);
+
+	psa_status_t status = psa_import_key(&attributes, key, ADV_CRYPTO_KEY_LEN, &key_id);
+	psa_reset_key_attributes(&attributes);
+	if (status != PSA_SUCCESS) {
+		LOG_ERR("key import failed, status %d", status);
+		return -EIO;
+	}
+	return 0;
+}
+
+// keystream block of the current counter
+static int compute_keystream(void)
+{
+	uint8_t nonce[AES_BLOCK_LEN] = {0};
+	size_t len;
+
+	if (key_id == PSA_KEY_ID_NULL) {
+		return -ENOKEY;
+	}
+	uint32_t start = perf_timer_start();
+	memcpy(nonce, mac, RUUVI_MAC_LEN);
+	nonce[NONCE_OFFSET_FORMAT] = RUUVI_F8_FORMAT;
+	sys_put_be32(counter, &nonce[NONCE_OFFSET_COUNTER]);
+
+	psa_status_t status = psa_cipher_encrypt(key_id, PSA_ALG_ECB_NO_PADDING, nonce,
+						 sizeof(nonce), keystream, sizeof(keystream), &len);
+	if (status != PSA_SUCCESS) {
+		LOG_ERR("keystream could not be computed, status %d", status);
+		return -EIO;
+	}
+	keystream_ready = true;
+	perf_timer_stop(PERF_TIMER_KEYSTREAM, start);
+	return 0;
+}
+
+int adv_crypto_encode(const ruuvi_rawv2_t *data, uint8_t *buf, size_t len)
+{
+	int err = 0;
+
+	if (!keystream_ready) {
+		err = compute_keystream();
+	}
+	if (err) {
+		// never advertise measurements in clear
+		ruuvi_rawv2_t unavailable;
+		ruuvi_rawv2_init(&unavailable);
+		memcpy(unavailable.mac, data->mac, RUUVI_MAC_LEN);
+		ruuvi_rawv2_encode(&unavailable, buf, len);
+		return err;
+	}
+
+	int written = ruuvi_f8_encode(data, counter, buf, len);
+	if (written < 0) {
+		return written;
+	}
+	for (int i = 0; i < RUUVI_F8_CIPHER_LEN; i++) {
+		buf[RUUVI_F8_CIPHER_OFFSET + i] ^= keystream[i];
+	}
+	// the keystream is used exactly once
+	keystream_ready = false;
+	counter++;
+	return written;
+}
+
+static void prepare_work_handler(struct k_work *work)
+{
+	if (!keystream_ready) {
+		compute_keystream();
+	}
+}
+
+void adv_crypto_prepare(void)
+{
+	k_work_submit_to_queue(&app_work_q, &prepare_work);
+}
+
+static void key_work_handler(struct k_work *work)
+{
+	if (!import_key(new_key)) {
+		LOG_INF("new key imported");
+		compute_keystream();
+	}
+	memset(new_key, 0, sizeof(new_key));
+}
+
+static int load_key_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+		       void *param)
+{
+	if (len != ADV_CRYPTO_KEY_LEN) {
+		return -EINVAL;
+	}
+	return read_cb(cb_arg, param, len) == len ? 0 : -EIO;
+}
+
+int init_adv_crypto(const uint8_t *payload_mac)
+{
+	uint8_t key[ADV_CRYPTO_KEY_LEN];
+	bool found = false;
+	int err;
+
+	memcpy(mac, payload_mac, RUUVI_MAC_LEN);
+	// a random start, so counters of different boots do not overlap
+	sys_csrand_get(&counter, sizeof(counter));
+
+	if (psa_crypto_init() != PSA_SUCCESS) {
+		LOG_ERR("PSA crypto init failed");
+		return -EIO;
+	}
+
+	err = settings_subsys_init();
+	if (err) {
+		LOG_ERR("settings init failed, err %d", err);
+		return err;
+	}
+	memset(key, 0, sizeof(key));
+	err = settings_load_subtree_direct(ADV_CRYPTO_SETTINGS_KEY, load_key_cb, key);
+	for (int i = 0; i < sizeof(key); i++) {
+		found |= key[i] != 0;
+	}
+	if (err || !found) {
+		LOG_WRN("no advertising key provisioned, measurements are not advertised");
+		return -ENOKEY;
+	}
+
+	err = import_key(key);
+	memset(key, 0, sizeof(key));
+	if (err) {
+		return err;
+	}
+	LOG_INF("advertisements are encrypted");
+	return compute_keystream();
+}
+
+#ifdef CONFIG_SHELL
+
+static int cmd_adv_key_set(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t key[ADV_CRYPTO_KEY_LEN];
+
+	if (strlen(argv[1]) != 2 * ADV_CRYPTO_KEY_LEN ||
+	    hex2bin(argv[1], strlen(argv[1]), key, sizeof(key)) != sizeof(key)) {
+		shell_error(sh, "the key must be %d hex digits", 2 * ADV_CRYPTO_KEY_LEN);
+		return -EINVAL;
+	}
+	// new_key is read by the work item until it finished, not only while it is queued
+	if (k_work_busy_get(&key_work)) {
+		shell_error(sh, "key change in progress");
+		return -EBUSY;
+	}
+	int err = settings_save_one(ADV_CRYPTO_SETTINGS_KEY, key, sizeof(key));
+	if (err) {
+		shell_error(sh, "key could not be stored, err %d", err);
+		return err;
+	}
+	memcpy(new_key, key, sizeof(new_key));
+	memset(key, 0, sizeof(key));
+	k_work_submit_to_queue(&app_work_q, &key_work);
+	shell_print(sh, "key stored, used from the next advertisement update");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(adv_key_cmds,
+			       SHELL_CMD_ARG(set, NULL, "Store the advertising key <hex>",
+					     cmd_adv_key_set, 2, 0),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(adv_key, &adv_key_cmds, "Advertising encryption key", NULL);
+
+#endif // CONFIG_SHELL
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @brief Encryption of the advertised measurements (format 8 style).
+ *
+ * The measurements are encrypted with AES-128 in counter mode: the keystream block of a payload is
+ * the AES encryption (PSA Crypto, CC310 on the nrf52840) of the nonce MAC | 0x08 | 00.. | counter,
+ * where the 32bit message counter is sent in clear (see ruuvi_f8_encode()). It starts at a random
+ * value after each boot and is incremented for every payload, so a nonce is never reused.
+ *
+ * As the counter of the next payload is known in advance, its keystream block is computed on the
+ * application work queue right after each publish. Encoding the next payload then only costs an
+ * XOR, the AES operation never adds to the time between sampling and advertising.
+ *
+ * The 128bit key is provisioned with the `adv_key set <32 hex digits>` shell command and stored in
+ * the settings (muuvi/adv_key). Without a key, only "not available" values are advertised.
+ */
+
+#ifndef ADV_CRYPTO_H
+#define ADV_CRYPTO_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/random/random.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <psa/crypto.h>
+
+#include <string.h>
+#include <autoconf.h>
+
+#include "perf.h"
+#include "ruuvi_codec.h"
+#include "scheduler.h"
+
+#define ADV_CRYPTO_KEY_LEN       16
+#define ADV_CRYPTO_SETTINGS_KEY  "muuvi/adv_key"
+
+#ifdef CONFIG_ADV_ENCRYPTION
+
+/**
+ * @brief load and import the key, and compute the keystream of the first payload.
+ *
+ * @param mac MAC address of the payload, most significant byte first
+ *
+ * @return 0 on success, -ENOKEY if no key has been provisioned, negative error code otherwise
+ */
+int init_adv_crypto(const uint8_t *mac);
+
+/**
+ * @brief encode and encrypt the given values as format 8 style manufacturer data.
+ *
+ * Uses the precomputed keystream, if it is not available (e.g. two updates in a row), it is
+ * computed right away. Without a key, "not available" values are encoded as RAWv2 instead.
+ * Must only be called from the application work queue.
+ *
+ * @return number of bytes written, negative error code otherwise
+ */
+int adv_crypto_encode(const ruuvi_rawv2_t *data, uint8_t *buf, size_t len);
+
+/**
+ * @brief compute the keystream of the next payload on the application work queue.
+ */
+void adv_crypto_prepare(void);
+
+#else
+
+static inline int init_adv_crypto(const uint8_t *mac)
+{
+	ARG_UNUSED(mac);
+	return -ENOTSUP;
+}
+
+static inline int adv_crypto_encode(const ruuvi_rawv2_t *data, uint8_t *buf, size_t len)
+{
+	ARG_UNUSED(data);
+	ARG_UNUSED(buf);
+	ARG_UNUSED(len);
+	return -ENOTSUP;
+}
+
+static inline void adv_crypto_prepare(void)
+{
+}
+
+#endif // CONFIG_ADV_ENCRYPTION
+
+#endif // ADV_CRYPTO_H
@@ -0,0 +1,48 @@
+#include "battery.h"
+
+LOG_MODULE_REGISTER(battery);
+
+static const struct adc_dt_spec vdd = ADC_DT_SPEC_GET(DT_PATH(zephyr_user));
+
+// only accessed from the application work queue (and init)
+static int16_t raw;
+static struct adc_sequence sequence = {
+	.buffer = &raw,
+	.buffer_size = sizeof(raw),
+};
+static uint32_t reads;
+
+int init_battery(void)
+{
+	if (!adc_is_ready_dt(&vdd)) {
+		LOG_ERR("ADC not ready");
+		return -ENODEV;
+	}
+	int err = adc_channel_setup_dt(&vdd);
+	if (err) {
+		LOG_ERR("VDD channel could not be set up, err %d", err);
+		return err;
+	}
+	return adc_sequence_init_dt(&vdd, &sequence);
+}
+
+int read_battery_voltage(uint16_t *voltage_mv)
+{
+	uint32_t start = perf_timer_start();
+
+	sequence.calibrate = reads++ % BATTERY_CALIBRATION_READS == 0;
+	int err = adc_read_dt(&vdd, &sequence);
+	if (err) {
+		LOG_WRN("VDD could not be sampled, err %d", err);
+		return err;
+	}
+	// single ended, noise around 0V may result in negative values
+	int32_t value = MAX(raw, 0);
+	err = adc_raw_to_millivolts_dt(&vdd, &value);
+	if (err) {
+		return err;
+	}
+	*voltage_mv = value;
+	perf_timer_stop(PERF_TIMER_BATTERY_READ, start);
+	return 0;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief Supply voltage measurement with the SAADC.
+ *
+ * VDD is sampled through the first io-channel of the zephyr,user node (see
+ * boards/nrf52840dongle_nrf52840.overlay): internal 0.6V reference, 1/6 gain, 4x oversampling.
+ * A read is a single burst of ~50us, the SAADC is only enabled for its duration. The offset is
+ * calibrated with the first read and then every BATTERY_CALIBRATION_READS reads, as it drifts with
+ * the temperature.
+ */
+
+#ifndef BATTERY_H
+#define BATTERY_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/adc.h>
+#include <zephyr/logging/log.h>
+
+#include <autoconf.h>
+
+#include "perf.h"
+
+// reported without a VDD channel, the dongle is powered by USB
+#define BATTERY_VOLTAGE_USB_MV    3300
+#define BATTERY_CALIBRATION_READS 64
+
+#ifdef CONFIG_BATTERY_VOLTAGE
+
+/**
+ * @brief set up the VDD channel of the SAADC.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int init_battery(void);
+
+/**
+ * @brief sample the supply voltage.
+ *
+ * Blocks for the duration of the conversion, must not be called from an ISR.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int read_battery_voltage(uint16_t *voltage_mv);
+
+#else
+
+static inline int init_battery(void)
+{
+	return -ENOTSUP;
+}
+
+static inline int read_battery_voltage(uint16_t *voltage_mv)
+{
+	ARG_UNUSED(voltage_mv);
+	return -ENOTSUP;
+}
+
+#endif // CONFIG_BATTERY_VOLTAGE
+
+#endif // BATTERY_H
@@ -2,155 +2,617 @@
 
 LOG_MODULE_REGISTER(ble);
 
-// see https://docs.ruuvi.com/communication/bluetooth-advertisements/data-format-5-rawv2
-// all payload values are initialized with their "not available" values
-static uint8_t mfg_data[] = {
-	// Company identifier (Ruuvi Innovations Ltd - 0x0499)
-	0x99, 0x04,
-	// Data format 5 (RAWv2)
-	0x05,
-	// Temperature in 0.005 degree steps
-	// valid values: -32767 ... 32767, "not available": 0x8000
-	0x80, 0x00,
-	// Humidity (16bit unsigned) in 0.0025% steps (0-163.83% range, though realistically 0-100%)
-	// valid values: 0 ... 40000, "not available": 0xFFFF
-	0xFF, 0xFF,
-	// Atmospheric pressure (16bit unsigned) in 1 Pa units, with offset of -50 000 Pa
-	// valid values: 0 ... 65534, "not available": 0xFFFF
-	0xFF, 0xFF,
-	// Acceleration-X (Most Significant Byte first)
-	// valid values: -32767 ... 32767, "not available": 0x8000
-	0x80, 0x00,
-	// Acceleration-Y (Most Significant Byte first)
-	// valid values: -32767 ... 32767, "not available": 0x8000
-	0x80, 0x00,
-	// Acceleration-Z (Most Significant Byte first)
-	// valid values: -32767 ... 32767, "not available": 0x8000
-	0x80, 0x00,
-	// Power info (11+5bit unsigned)
-	// First 11 bits is the battery voltage above 1.6V, in millivolts (1.6V to 3.646V range)
-	// Last 5 bits unsigned are the TX power above -40dBm - +20dB,, in 2dBm steps.
-	// valid values: 0 ... 2046 and 0 ... 30 respectively
-	// statically set to 3.3V, since its powered by USB
-	// 3.3V = 1700 = 11010100100, +0dBm = 20 = 10100 => 1101010010010100_b = 0xD494_h
-	0xD4, 0x94, // static
-	// Movement counter (8 bit unsigned), incremented by motion detection interrupts from
-	// accelerometer
-	// valie values: 0 ... 254, "not available": 0xFF
-	0xFF, // unused
-	// Measurement sequence number (16 bit unsigned), each time a measurement is taken, this is
-	// incremented by one, used for measurement de-duplication.
-	// Depending on the transmit interval, multiple packets with the same measurements can be
-	// sent, and there may be measurements that never were sent.
-	// valid values: 0 ... 65534, "not available": 0xFFFF
-	0xFF, 0xFF, // incremented each time a measurement is recorded
-	// any valid MAC address
-	// will be dynamically set by the firmware after the BLE module is initialized
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-
-// advertisement parameters
-static const struct bt_le_adv_param adv_params = {
+// current payload values, all values are initialized with their "not available" values
+// except for the tx power, which is the level in use
+static ruuvi_rawv2_t payload_values;
+
+// double buffered payload, the controller only ever gets handed the active buffer, while new
+// measurements are written into the inactive one. This way advertising never has to be stopped
+// and a payload is never modified while it is in use.
+static uint8_t mfg_data[2][RUUVI_RAWV2_LEN];
+// index of the payload buffer currently being advertised
+static atomic_t active_payload = ATOMIC_INIT(0);
+// number of active connections, advertising can not be restarted while all slots are in use
+static atomic_t connections = ATOMIC_INIT(0);
+
+#ifdef CONFIG_ADV_CODED_PHY
+// connectable extended advertising on the coded PHY, coded advertising can not be scannable
+#define ADV_OPTIONS                                                                                \
+	(BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_CODED |                  \
+	 (IS_ENABLED(CONFIG_ADV_CODED_PHY_S8) ? BT_LE_ADV_OPT_REQUIRE_S8_CODING : 0))
+#else
+// connectable and scannable legacy advertising
+#define ADV_OPTIONS BT_LE_ADV_OPT_CONNECTABLE
+#endif
+
+// advertisement parameters, changed measurements are advertised with the fast interval for the
+// fast duration, afterwards the slow interval is used until the next change. The intervals are
+// runtime parameters (params.h), only accessed from the application work queue (and init).
+static struct bt_le_adv_param adv_params_fast = {
+	.id = BT_ID_DEFAULT,
+	.options = ADV_OPTIONS,
+	.interval_min = ADV_INTERVAL(CONFIG_ADV_INTERVAL_FAST_MS),
+	.interval_max = ADV_INTERVAL(CONFIG_ADV_INTERVAL_FAST_MS * 6 / 5),
+	.peer = NULL,
+};
+
+static struct bt_le_adv_param adv_params_slow = {
 	.id = BT_ID_DEFAULT,
-	.options = BT_LE_ADV_OPT_CONNECTABLE,        // advertise as connectable
-	.interval_min = BT_GAP_PER_ADV_SLOW_INT_MIN, // 1s
-	.interval_max = BT_GAP_PER_ADV_SLOW_INT_MAX, // 1.2s
+	.options = ADV_OPTIONS,
+	.interval_min = ADV_INTERVAL(CONFIG_ADV_INTERVAL_SLOW_MS),
+	.interval_max = ADV_INTERVAL(CONFIG_ADV_INTERVAL_SLOW_MS * 6 / 5),
 	.peer = NULL,
 };
 
+// whether the fast interval is in use, only accessed from the application work queue
+static bool adv_fast = false;
+// uptime of the last switch to the slow interval, see CONFIG_ADV_FAST_HOLDOFF_SEC
+static int64_t adv_slow_since_ms;
+// whether advertising has been started once, parameter changes are only applied from then on
+static bool adv_started = false;
+// set if advertising could not be started because all connection slots were in use
+static atomic_t adv_pending = ATOMIC_INIT(0);
+
+static void adv_slow_work_handler(struct k_work *work);
+static void adv_resume_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(adv_slow_work, adv_slow_work_handler);
+static K_WORK_DEFINE(adv_resume_work, adv_resume_work_handler);
+
+static uint8_t adv_backend_handle(void);
+
 // client connected callback
 static void connected(struct bt_conn *conn, uint8_t err)
 {
+	TRACE_POINT("connected", err, 0);
 	if (err) {
-		LOG_ERR("Connection failed, error: 0x%02x %s", err, bt_hci_err_to_str(err));
+		LOG_ERR("Connection failed, error: 0x%02x", err);
 		set_led_pattern(&PATTERN_BLE_CONNECTION_FAILED);
+		perf_inc(PERF_CONNECTION_FAILURES);
 		return;
 	}
 
+	atomic_inc(&connections);
+	perf_inc(PERF_CONNECTIONS);
 	set_led_pattern(&PATTERN_BLE_CONNECTED);
+	conn_setup_start(conn);
 
-	struct bt_conn_info info;
-	if (bt_conn_get_info(conn, &info)) {
-		LOG_ERR("Connected to unknown device");
-		return;
-	}
-
-	char addr_str[BT_ADDR_LE_STR_LEN];
-	bt_addr_le_to_str_without_type(info.le.dst, addr_str, sizeof(addr_str));
-
-	LOG_INF("Connected to device '%s'", addr_str);
+	LOG_INF("Connected to device '" ADDR_FMT "'", ADDR_ARGS(bt_conn_get_dst(conn)));
 }
 
 // client disconnected callback
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
+	TRACE_POINT("disconnected", reason, 0);
+	atomic_dec(&connections);
+	perf_inc(PERF_DISCONNECTIONS);
 	set_led_pattern(&PATTERN_BLE_DISCONNECTED);
-
-	struct bt_conn_info info;
-	if (bt_conn_get_info(conn, &info)) {
-		LOG_INF("Device disconnected, reason: 0x%02x %s", reason,
-			bt_hci_err_to_str(reason));
-		return;
+	if (atomic_get(&adv_pending)) {
+		// a connection slot is free again
+		k_work_submit_to_queue(&app_work_q, &adv_resume_work);
 	}
 
-	char addr_str[BT_ADDR_LE_STR_LEN];
-	bt_addr_le_to_str_without_type(info.le.dst, addr_str, sizeof(addr_str));
-
-	LOG_INF("Device '%s' disconnected, reason: 0x%02x %s", addr_str, reason,
-		bt_hci_err_to_str(reason));
+	// the reason is an HCI error code, see bt_hci_err_to_str()
+	LOG_INF("Device '" ADDR_FMT "' disconnected, reason: 0x%02x",
+		ADDR_ARGS(bt_conn_get_dst(conn)), reason);
 }
 
-// advertisement data
-static const struct bt_data ad[] = {
-	BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data, sizeof(mfg_data)) // measurements
+// connection callbacks, must stay valid after registration
+static struct bt_conn_cb conn_callbacks = {
+	.connected = connected,
+	.disconnected = disconnected,
 };
 
+// tx power of the advertising set in dBm, as selected by the controller. Only accessed from the
+// application work queue, the scan response and the payload always carry this level.
+static int8_t adv_tx_power = CONFIG_BT_CTLR_TX_PWR_DBM;
+
 // scan response data
 static char device_name[DEVICE_NAME_MAX_LEN];
+static int8_t sd_tx_power = CONFIG_BT_CTLR_TX_PWR_DBM;
 static struct bt_data sd[] = {
 	BT_DATA(BT_DATA_NAME_COMPLETE, device_name, 0), // device name, set dynamically
-	BT_DATA(BT_DATA_TX_POWER, "\x00", 1),           // tx power level (+0dBm), static
+	BT_DATA(BT_DATA_TX_POWER, &sd_tx_power, 1),     // tx power level, set with the payload
+};
+
+#ifdef CONFIG_ADV_CODED_PHY
+// advertisement data, one set per payload buffer. There is no scan response on the coded PHY, so
+// the device name is advertised along with the measurements.
+static struct bt_data ad[2][2] = {
+	{
+		BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data[0], sizeof(mfg_data[0])),
+		BT_DATA(BT_DATA_NAME_COMPLETE, device_name, 0),
+	},
+	{
+		BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data[1], sizeof(mfg_data[1])),
+		BT_DATA(BT_DATA_NAME_COMPLETE, device_name, 0),
+	},
+};
+#else
+// advertisement data, one set per payload buffer
+static const struct bt_data ad[2][1] = {
+	{BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data[0], sizeof(mfg_data[0]))}, // measurements
+	{BT_DATA(BT_DATA_MANUFACTURER_DATA, mfg_data[1], sizeof(mfg_data[1]))}, // measurements
+};
+#endif
+
+#ifdef CONFIG_ADV_E1
+
+// E1 payload, advertised by a second, non-connectable extended advertising set with its own
+// interval. It is encoded from the same measurements as the RAWv2 payload.
+static ruuvi_e1_t e1_values;
+static uint8_t e1_data[2][RUUVI_E1_LEN];
+static const struct bt_data e1_ad[2][1] = {
+	{BT_DATA(BT_DATA_MANUFACTURER_DATA, e1_data[0], sizeof(e1_data[0]))},
+	{BT_DATA(BT_DATA_MANUFACTURER_DATA, e1_data[1], sizeof(e1_data[1]))},
+};
+
+// advertised with the identity address, so gateways can match both payloads
+static const struct bt_le_adv_param e1_params = {
+	.id = BT_ID_DEFAULT,
+	.sid = 1,
+	.options = BT_LE_ADV_OPT_EXT_ADV | BT_LE_ADV_OPT_USE_IDENTITY,
+	.interval_min = ADV_INTERVAL(CONFIG_ADV_E1_INTERVAL_MS),
+	.interval_max = ADV_INTERVAL(CONFIG_ADV_E1_INTERVAL_MS * 6 / 5),
+	.peer = NULL,
 };
 
+static struct bt_le_ext_adv *e1_set;
+// the E1 set is started with the first payload, it is never stopped by connections
+static bool e1_running = false;
+// 24 bit E1 sequence number, starts at 0 with the first measurement
+static uint32_t e1_sequence_number = RUUVI_E1_SEQUENCE_NA;
+
+static int e1_init(const uint8_t *mac)
+{
+	ruuvi_e1_init(&e1_values);
+	memcpy(e1_values.mac, mac, RUUVI_MAC_LEN);
+	return bt_le_ext_adv_create(&e1_params, NULL, &e1_set);
+}
+
+static void e1_update(atomic_val_t buffer)
+{
+	// same (already "not available" mapped) values as the RAWv2 payload
+	e1_values.temperature = payload_values.temperature;
+	e1_values.humidity = payload_values.humidity;
+	e1_sequence_number++;
+	if (e1_sequence_number > RUUVI_E1_SEQUENCE_MAX) {
+		e1_sequence_number = 0;
+	}
+	e1_values.sequence_number = e1_sequence_number;
+	ruuvi_e1_encode(&e1_values, e1_data[buffer], sizeof(e1_data[buffer]));
+}
+
+static int e1_publish(atomic_val_t buffer)
+{
+	int err = bt_le_ext_adv_set_data(e1_set, e1_ad[buffer], ARRAY_SIZE(e1_ad[buffer]), NULL, 0);
+	if (err || e1_running) {
+		return err;
+	}
+	err = bt_le_ext_adv_start(e1_set, BT_LE_EXT_ADV_START_DEFAULT);
+	e1_running = !err;
+	return err;
+}
+
+#else
+
+static int e1_init(const uint8_t *mac)
+{
+	return 0;
+}
+
+static void e1_update(atomic_val_t buffer)
+{
+}
+
+static int e1_publish(atomic_val_t buffer)
+{
+	return 0;
+}
+
+#endif // CONFIG_ADV_E1
+
+// encodes the current payload values into the given buffer, encrypted if enabled
+static void encode_payload(uint8_t *buf)
+{
+	if (IS_ENABLED(CONFIG_ADV_ENCRYPTION)) {
+		adv_crypto_encode(&payload_values, buf, RUUVI_RAWV2_LEN);
+	} else {
+		ruuvi_rawv2_encode(&payload_values, buf, RUUVI_RAWV2_LEN);
+	}
+}
+
 // sequence number, will be updated whenever a new measurement is recorded
 // set initial value to 65535 to indicate "not available" if, for some reason, the sequence number
 // is not updated
 static uint16_t sequence_number = 65535;
 
-// boolean to indicate advertising state
-static bool is_advertising = false;
-
-void update_advertisement_data(uint8_t *mfg_data)
-{
-	LOG_INF("collecting measurements...");
-	// turn on the green channel of the LED to indicate measurement collecting
-	set_led_pattern(&PATTERN_COLLECTING_SENSOR);
-	k_sleep(K_SECONDS(2));
-	// get temperature value
-	measurement_t measurements;
-	read_sensor_values(&measurements);
-	// update temperature in advertisement data
-	mfg_data[3] = (measurements.temperature >> 8) & 0xFF;
-	mfg_data[4] = measurements.temperature & 0xFF;
-	// update humidity in advertisement data
-	mfg_data[5] = (measurements.humidity >> 8) & 0xFF;
-	mfg_data[6] = measurements.humidity & 0xFF;
+// applies the tx power level of the next payload before it is encoded, so the payload never
+// claims a level which is not in use
+static void update_tx_power(void)
+{
+	int8_t level = tx_power_next(sequence_number);
+
+	if (level != adv_tx_power) {
+		int8_t selected;
+		if (!tx_power_set_adv(adv_backend_handle(), level, &selected)) {
+			adv_tx_power = selected;
+		}
+		// the next step starts from the level in use, also if it could not be changed
+		tx_power_applied(adv_tx_power);
+	}
+	payload_values.tx_power = adv_tx_power;
+	sd_tx_power = adv_tx_power;
+}
+
+void update_advertisement_data(const measurement_t *measurements)
+{
+	uint32_t start = perf_timer_start();
+
+	if (IS_ENABLED(CONFIG_TX_POWER_ADAPTIVE)) {
+		update_tx_power();
+	}
+
+	payload_values.temperature = measurements->temperature == MEASUREMENT_TEMPERATURE_NA
+					     ? RUUVI_TEMPERATURE_NA
+					     : measurements->temperature;
+	payload_values.humidity = measurements->humidity == MEASUREMENT_HUMIDITY_NA
+					  ? RUUVI_HUMIDITY_NA
+					  : measurements->humidity;
+	payload_values.battery_voltage = measurements->battery_voltage == MEASUREMENT_BATTERY_NA
+						 ? RUUVI_BATTERY_NA
+						 : measurements->battery_voltage;
+	for (int axis = 0; axis < 3; axis++) {
+		payload_values.acceleration[axis] =
+			measurements->acceleration[axis] == MEASUREMENT_ACCELERATION_NA
+				? RUUVI_ACCELERATION_NA
+				: measurements->acceleration[axis];
+	}
+	payload_values.movement_counter = measurements->movement_counter;
 	// update sequence number in advertisement data
 	sequence_number++;
 	// reset sequence number if its > 65534, as the max allowed value is 65534
 	// 65535 is reserved for "not available"
-	if (sequence_number > 65534) {
+	if (sequence_number > RUUVI_RAWV2_SEQUENCE_MAX) {
 		// reset sequence number, if greater than allowed value
 		// sequence number will be reset every ~23 days with advertisements every 30 seconds
 		sequence_number = 0;
 	}
-	mfg_data[18] = (sequence_number >> 8) & 0xFF;
-	mfg_data[19] = sequence_number & 0xFF;
+	payload_values.sequence_number = sequence_number;
+
+	// only the inactive buffer is written, it is not referenced by the controller
+	atomic_val_t active = atomic_get(&active_payload);
+	encode_payload(mfg_data[!active]);
+	e1_update(!active);
+	perf_timer_stop(PERF_TIMER_ADV_UPDATE, start);
+	TRACE_POINT("encode", sequence_number, !active);
+
+	// fixed-point, in 0.01 degree / 0.01% steps, so no float formatting is needed
+	int32_t temperature = measurements->temperature / 2;
+	uint32_t humidity = measurements->humidity / 4;
+	// the BabbleSim scanner matches its receptions against this line (tests/bsim/report.py)
+	LOG_INF("updated advertising values: sequence %u, sampled at %u ms, temperature: "
+		"%s%d.%02d, humidity: %u.%02u",
+		sequence_number, measurements->sampled_ms,
+		temperature < 0 ? "-" : "", abs(temperature) / 100, abs(temperature) % 100,
+		humidity / 100, humidity % 100);
+}
+
+#ifdef CONFIG_BT_EXT_ADV
+
+static struct bt_le_ext_adv *adv_set;
+// extended advertising does not report updates while stopped, so track it here
+static atomic_t adv_running = ATOMIC_INIT(0);
+
+// the advertising set stops once a connection has been created from it
+static void adv_connected(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_connected_info *info)
+{
+	atomic_set(&adv_running, 0);
+	atomic_set(&adv_pending, 1);
+	k_work_submit_to_queue(&app_work_q, &adv_resume_work);
+}
+
+static const struct bt_le_ext_adv_cb adv_callbacks = {
+	.connected = adv_connected,
+};
+
+static int adv_backend_init(void)
+{
+	return bt_le_ext_adv_create(&adv_params_slow, &adv_callbacks, &adv_set);
+}
+
+static uint8_t adv_backend_handle(void)
+{
+	return bt_le_ext_adv_get_index(adv_set);
+}
+
+static int adv_backend_set_data(atomic_val_t buffer)
+{
+	if (IS_ENABLED(CONFIG_ADV_CODED_PHY)) {
+		return bt_le_ext_adv_set_data(adv_set, ad[buffer], ARRAY_SIZE(ad[buffer]), NULL, 0);
+	}
+	// legacy advertising PDUs, scannable
+	return bt_le_ext_adv_set_data(adv_set, ad[buffer], ARRAY_SIZE(ad[buffer]), sd,
+				      ARRAY_SIZE(sd));
+}
+
+static int adv_backend_start(const struct bt_le_adv_param *params, atomic_val_t buffer)
+{
+	int err = bt_le_ext_adv_update_param(adv_set, params);
+	if (err) {
+		return err;
+	}
+	err = adv_backend_set_data(buffer);
+	if (err) {
+		return err;
+	}
+	err = bt_le_ext_adv_start(adv_set, BT_LE_EXT_ADV_START_DEFAULT);
+	atomic_set(&adv_running, !err);
+	return err;
+}
+
+static int adv_backend_stop(void)
+{
+	atomic_set(&adv_running, 0);
+	return bt_le_ext_adv_stop(adv_set);
+}
+
+static int adv_backend_update(atomic_val_t buffer)
+{
+	if (!atomic_get(&adv_running)) {
+		return -EAGAIN;
+	}
+	return adv_backend_set_data(buffer);
+}
+
+#else
+
+static int adv_backend_init(void)
+{
+	return 0;
+}
+
+// the host uses the first advertising handle for legacy advertising
+static uint8_t adv_backend_handle(void)
+{
+	return 0;
+}
+
+static int adv_backend_start(const struct bt_le_adv_param *params, atomic_val_t buffer)
+{
+	return bt_le_adv_start(params, ad[buffer], ARRAY_SIZE(ad[buffer]), sd, ARRAY_SIZE(sd));
+}
+
+static int adv_backend_stop(void)
+{
+	return bt_le_adv_stop();
+}
+
+// returns -EAGAIN if advertising is not running
+static int adv_backend_update(atomic_val_t buffer)
+{
+	return bt_le_adv_update_data(ad[buffer], ARRAY_SIZE(ad[buffer]), sd, ARRAY_SIZE(sd));
+}
+
+#endif // CONFIG_BT_EXT_ADV
+
+static const struct bt_le_adv_param *current_adv_params(void)
+{
+	return adv_fast ? &adv_params_fast : &adv_params_slow;
+}
+
+// start advertising the given payload buffer
+static int start_advertising(const struct bt_le_adv_param *params, atomic_val_t buffer)
+{
+	int err = adv_backend_start(params, buffer);
+	if (err == -EALREADY) {
+		// legacy advertising has already been resumed by the host after a disconnect, only
+		// make sure it carries the given payload
+		err = adv_backend_update(buffer);
+	}
+	TRACE_POINT("adv_start", sequence_number, err);
+	adv_started |= !err;
+	if (IS_ENABLED(CONFIG_TRACE_ADV_EVENTS) && !err) {
+		trace_adv_events_enable(adv_backend_handle());
+	}
+	// restarting the set may reset its tx power to the default one
+	if (IS_ENABLED(CONFIG_TX_POWER_ADAPTIVE) && !err &&
+	    adv_tx_power != CONFIG_BT_CTLR_TX_PWR_DBM) {
+		int8_t selected;
+		tx_power_set_adv(adv_backend_handle(), adv_tx_power, &selected);
+	}
+	if (err == -ENOMEM && atomic_get(&connections) > 0) {
+		// all connection slots are in use, advertising is resumed on disconnect
+		LOG_DBG("advertising paused while connected");
+		atomic_set(&adv_pending, 1);
+		return 0;
+	}
+	atomic_set(&adv_pending, 0);
+	if (err) {
+		perf_inc(PERF_ADV_START_FAILURES);
+	}
+	return err;
+}
+
+// advertising parameters can not be updated while advertising, it has to be restarted
+static int restart_advertising(const struct bt_le_adv_param *params, atomic_val_t buffer)
+{
+	uint32_t start = perf_timer_start();
+	int err = adv_backend_stop();
+	if (err) {
+		LOG_WRN("advertising could not be stopped, err %d", err);
+	}
+	err = start_advertising(params, buffer);
+	perf_timer_stop(PERF_TIMER_ADV_RESTART, start);
+	perf_inc(PERF_ADV_RESTARTS);
+	return err;
+}
+
+// a change shortly after backing off stays in the slow interval, this bounds the restarts
+static bool adv_fast_allowed(void)
+{
+	return !adv_started ||
+	       k_uptime_get() - adv_slow_since_ms >= CONFIG_ADV_FAST_HOLDOFF_SEC * MSEC_PER_SEC;
+}
+
+static void adv_slow_work_handler(struct k_work *work)
+{
+	LOG_DBG("switching to the slow advertising interval");
+	adv_fast = false;
+	adv_slow_since_ms = k_uptime_get();
+	int err = restart_advertising(&adv_params_slow, atomic_get(&active_payload));
+	if (err) {
+		LOG_ERR("advertising could not be restarted, err %d", err);
+		set_led_pattern(&PATTERN_BLE_ADVERTISING_FAILED);
+	}
+}
 
-	LOG_INF("updated advertising values: temperature: %f, humidity: %f",
-		measurements.temperature * 0.005, measurements.humidity * 0.0025);
+static void adv_resume_work_handler(struct k_work *work)
+{
+	if (!atomic_get(&adv_pending)) {
+		return;
+	}
+	int err = start_advertising(current_adv_params(), atomic_get(&active_payload));
+	if (err) {
+		LOG_ERR("advertising could not be resumed, err %d", err);
+	}
 }
 
-void init_ble()
+int publish_advertisement_data(void)
+{
+	int err;
+	atomic_val_t next = !atomic_get(&active_payload);
+
+	int32_t fast_duration_sec = params_get(PARAM_ADV_FAST_DURATION_SEC);
+
+	if (!adv_fast && fast_duration_sec > 0 && adv_fast_allowed()) {
+		// new measurements, switch to the fast interval
+		err = restart_advertising(&adv_params_fast, next);
+		adv_fast = !err;
+	} else {
+		// update the payload in place, the controller copies it atomically
+		err = adv_backend_update(next);
+		TRACE_POINT("adv_update", sequence_number, err);
+		if (err == -EAGAIN) {
+			// advertising is not running (yet), start it with the new payload
+			err = start_advertising(current_adv_params(), next);
+		} else if (err) {
+			perf_inc(PERF_ADV_UPDATE_FAILURES);
+		}
+	}
+	if (err) {
+		LOG_ERR("advertisement data could not be published, err %d", err);
+		return err;
+	}
+	// the controller advertises the new payload from its next event on
+	trace_adv_payload(sequence_number);
+	// the RAWv2 set is the primary one, the E1 set does not affect the publish result
+	int e1_err = e1_publish(next);
+	if (e1_err) {
+		LOG_ERR("E1 advertisement data could not be published, err %d", e1_err);
+		perf_inc(PERF_ADV_UPDATE_FAILURES);
+	}
+	if (adv_fast) {
+		// (re)start the fast period
+		k_work_reschedule_for_queue(&app_work_q, &adv_slow_work,
+					    K_SECONDS(fast_duration_sec));
+	}
+	atomic_set(&active_payload, next);
+	TRACE_POINT("swap", sequence_number, next);
+	perf_inc(PERF_ADV_CYCLES);
+	// the keystream of the next payload is computed after the current work item
+	if (IS_ENABLED(CONFIG_ADV_ENCRYPTION)) {
+		adv_crypto_prepare();
+	}
+	if (IS_ENABLED(CONFIG_PERSIST_SEQUENCE)) {
+		persist_store(&payload_values);
+	}
+	// the heartbeat carries the payload without the company identifier
+	nus_heartbeat(&mfg_data[next][2], sizeof(mfg_data[next]) - 2);
+	LOG_INF("advertising sequence %d...", sequence_number);
+	return 0;
+}
+
+// sets the interval of the advertising parameters, the maximum leaves the controller some room
+static void set_adv_interval(struct bt_le_adv_param *params, uint32_t interval_ms)
+{
+	params->interval_min = ADV_INTERVAL(interval_ms);
+	params->interval_max = ADV_INTERVAL(interval_ms * 6 / 5);
+}
+
+// sets the device name and appends the last 2 bytes of the MAC address
+static void set_device_name(void)
+{
+	char name[PARAMS_NAME_MAX_LEN + 1];
+
+	params_get_string(PARAM_DEVICE_NAME, name, sizeof(name));
+	snprintf(device_name, sizeof(device_name), "%s %02X%02X", name,
+		 payload_values.mac[RUUVI_MAC_LEN - 2], payload_values.mac[RUUVI_MAC_LEN - 1]);
+	// update the length of the device name scan response
+	sd[0].data_len = strlen(device_name);
+#ifdef CONFIG_ADV_CODED_PHY
+	for (int b = 0; b < ARRAY_SIZE(ad); b++) {
+		ad[b][1].data_len = strlen(device_name);
+	}
+#endif
+	if (IS_ENABLED(CONFIG_BT_DEVICE_NAME_DYNAMIC)) {
+		// GAP device name characteristic
+		bt_set_name(device_name);
+	}
+}
+
+static bool load_adv_params(void)
+{
+	uint16_t slow_interval = adv_params_slow.interval_min;
+
+	set_adv_interval(&adv_params_fast, params_get(PARAM_ADV_INTERVAL_FAST_MS));
+	set_adv_interval(&adv_params_slow, params_get(PARAM_ADV_INTERVAL_SLOW_MS));
+	return adv_params_slow.interval_min != slow_interval;
+}
+
+void apply_advertising_params(void)
+{
+	bool slow_changed = load_adv_params();
+
+	set_device_name();
+	if (!adv_started) {
+		return;
+	}
+	if (!adv_fast && slow_changed) {
+		// the interval can only be changed by a restart, the first event with the new
+		// interval follows right away
+		int err = restart_advertising(&adv_params_slow, atomic_get(&active_payload));
+		if (err) {
+			LOG_ERR("advertising could not be restarted, err %d", err);
+		}
+		return;
+	}
+	// a new fast interval is used with the next measurement change, the slow one with the
+	// switch to it. The name is updated in place.
+	int err = adv_backend_update(atomic_get(&active_payload));
+	if (err && err != -EAGAIN) {
+		LOG_WRN("device name could not be updated, err %d", err);
+	}
+}
+
+// restores the payload of the previous boot, until the first measurements replace it
+static bool restore_payload(void)
+{
+	ruuvi_rawv2_t cached;
+	uint16_t last_sequence;
+
+	if (!IS_ENABLED(CONFIG_PERSIST_SEQUENCE) || persist_load(&cached, &last_sequence)) {
+		return false;
+	}
+	// address and tx power are the ones in use now
+	memcpy(cached.mac, payload_values.mac, RUUVI_MAC_LEN);
+	cached.tx_power = payload_values.tx_power;
+	payload_values = cached;
+	sequence_number = last_sequence;
+	return true;
+}
+
+int init_ble(void)
 {
 	int err;
 	LOG_INF("initializing BLE module...");
@@ -158,15 +620,12 @@ void init_ble()
 	if (err) {
 		set_led_pattern(&PATTERN_BLE_INIT_FAILED);
 		LOG_ERR("BLE init failed, err %d", err);
-		return;
+		return err;
 	}
 
 	// register connection callbacks
-	struct bt_conn_cb conn_callbacks = {
-		.connected = connected,
-		.disconnected = disconnected,
-	};
 	bt_conn_cb_register(&conn_callbacks);
+	init_conn_setup();
 	// init gatt services
 	init_gatt_services();
 
@@ -174,40 +633,42 @@ void init_ble()
 	bt_addr_le_t addr;
 	size_t count = 1;
 	bt_id_get(&addr, &count);
-	// set mac address of payload bytes 20 - 25 from addr.a (neds to be in reverse order)
-	for (int i = 0; i < 6; i++) {
-		mfg_data[20 + i] = addr.a.val[5 - i];
+	ruuvi_rawv2_init(&payload_values);
+	payload_values.battery_voltage =
+		IS_ENABLED(CONFIG_BATTERY_VOLTAGE) ? RUUVI_BATTERY_NA : BATTERY_VOLTAGE_USB_MV;
+	payload_values.tx_power = adv_tx_power;
+	// the payload carries the mac address most significant byte first (reverse order)
+	for (int i = 0; i < RUUVI_MAC_LEN; i++) {
+		payload_values.mac[i] = addr.a.val[5 - i];
 	}
-	// set the device name and append the last 2 bytes of the MAC address to the name
-	snprintf(device_name, sizeof(device_name), "%s %02X%02X", CONFIG_BT_DEVICE_NAME,
-		 addr.a.val[1], addr.a.val[0]);
-	// update the length of the device name scan response
-	sd[0].data_len = strlen(device_name);
-	LOG_INF("visible as '%s' with address '%02X:%02X:%02X:%02X:%02X:%02X'", device_name,
-		addr.a.val[5], addr.a.val[4], addr.a.val[3], addr.a.val[2], addr.a.val[1],
-		addr.a.val[0]);
-
-	LOG_INF("BLE initialized, starting advertisement cycle...");
-	while (true) {
-		// stop advertising before updating the data
-		if (is_advertising) {
-			LOG_INF("stopping advertising sequence %d...", sequence_number);
-			bt_le_adv_stop();
-			is_advertising = false;
-		}
-		// update the advertisement data
-		update_advertisement_data(mfg_data);
-		// restart advertising with updated data
-		err = bt_le_adv_start(&adv_params, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	bool restored = restore_payload();
+	if (IS_ENABLED(CONFIG_ADV_ENCRYPTION)) {
+		init_adv_crypto(payload_values.mac);
+	}
+	for (int b = 0; b < ARRAY_SIZE(mfg_data); b++) {
+		encode_payload(mfg_data[b]);
+	}
+	set_device_name();
+	load_adv_params();
+	LOG_INF("visible as '%s' with address '" ADDR_FMT "'", device_name, ADDR_ARGS(&addr));
+
+	err = adv_backend_init();
+	if (!err) {
+		err = e1_init(payload_values.mac);
+	}
+	if (err) {
+		set_led_pattern(&PATTERN_BLE_INIT_FAILED);
+		LOG_ERR("advertising set could not be created, err %d", err);
+		return err;
+	}
+	if (restored) {
+		// the cached payload goes out right away, not only after the first measurement cycle
+		err = start_advertising(current_adv_params(), atomic_get(&active_payload));
 		if (err) {
-			set_led_pattern(&PATTERN_BLE_ADVERTISING_FAILED);
-			LOG_ERR("advertisement failed to start, err %d", err);
-			return;
+			LOG_WRN("cached payload could not be advertised, err %d", err);
 		}
-		is_advertising = true;
-		set_led_pattern(&PATTERN_BLE_ADVERTISING);
-		LOG_INF("advertising sequence %d started...", sequence_number);
-		// sleep until next measurement interval
-		k_sleep(MEASUREMENT_INTERVAL);
 	}
-}
\ No newline at end of file
+
+	LOG_INF("BLE initialized");
+	return 0;
+}
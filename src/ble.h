@@ -12,17 +12,61 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <autoconf.h>
 
+#include "adv_crypto.h"
+#include "battery.h"
+#include "conn_setup.h"
 #include "gatt.h"
 #include "led.h"
+#include "params.h"
+#include "perf.h"
+#include "persist.h"
+#include "ruuvi_codec.h"
+#include "scheduler.h"
 #include "sensors.h"
+#include "trace.h"
+#include "tx_power.h"
 #include "utils.h"
 
-#define MEASUREMENT_INTERVAL K_SECONDS(30)
-#define DEVICE_NAME_MAX_LEN  50
+#define DEVICE_NAME_MAX_LEN 50
+// advertising interval in units of 0.625ms
+#define ADV_INTERVAL(_ms)   ((_ms) * 8 / 5)
 
-void init_ble();
+/**
+ * @brief enable the BLE stack, register the GATT services and prepare the advertisement payload.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int init_ble(void);
+
+/**
+ * @brief encode the given measurements into the advertisement payload and bump the sequence
+ * number.
+ */
+void update_advertisement_data(const measurement_t *measurements);
+
+/**
+ * @brief publish the most recently encoded advertisement payload.
+ *
+ * The payload is advertised with the fast interval for the fast duration (params.h), then with the
+ * slow interval until the next update. Advertising is only restarted when switching the interval,
+ * otherwise the payload is updated in place. Within CONFIG_ADV_FAST_HOLDOFF_SEC after backing off,
+ * updates stay in the slow interval. Must be called from the application work queue.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int publish_advertisement_data(void);
+
+/**
+ * @brief apply changed advertising intervals and device name.
+ *
+ * The name is updated in place. In the slow phase, a new slow interval restarts advertising right
+ * away, otherwise the intervals are used from the next switch between them on. Must be called from
+ * the application work queue.
+ */
+void apply_advertising_params(void);
 
 #endif // BLE_H
\ No newline at end of file
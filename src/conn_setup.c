@@ -0,0 +1,116 @@
+#include "conn_setup.h"
+
+LOG_MODULE_REGISTER(conn_setup);
+
+// pending setup per connection, indexed by bt_conn_index()
+typedef struct {
+	struct k_work work;
+	struct bt_conn *conn;
+} conn_setup_t;
+
+static conn_setup_t setups[CONFIG_BT_MAX_CONN];
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err,
+			  struct bt_gatt_exchange_params *params)
+{
+	if (err) {
+		LOG_WRN("MTU exchange failed, err 0x%02x", err);
+	}
+}
+
+static struct bt_gatt_exchange_params mtu_params[CONFIG_BT_MAX_CONN];
+
+static void setup_work_handler(struct k_work *work)
+{
+	conn_setup_t *setup = CONTAINER_OF(work, conn_setup_t, work);
+	struct bt_conn *conn = setup->conn;
+	struct bt_conn_info info;
+	int err;
+
+	err = bt_conn_get_info(conn, &info);
+	if (err || info.state != BT_CONN_STATE_CONNECTED) {
+		goto done;
+	}
+
+	if (info.le.phy->rx_phy != BT_GAP_LE_PHY_CODED) {
+		err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+		if (err) {
+			LOG_WRN("PHY update could not be requested, err %d", err);
+		}
+	}
+
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		LOG_WRN("data length update could not be requested, err %d", err);
+	}
+
+	struct bt_gatt_exchange_params *params = &mtu_params[bt_conn_index(conn)];
+	params->func = mtu_exchanged;
+	err = bt_gatt_exchange_mtu(conn, params);
+	if (err && err != -EALREADY) {
+		LOG_WRN("MTU exchange could not be started, err %d", err);
+	}
+
+	err = bt_conn_le_param_update(
+		conn, BT_LE_CONN_PARAM(CONN_INTERVAL(CONFIG_CONN_INTERVAL_MIN_MS),
+				       CONN_INTERVAL(CONFIG_CONN_INTERVAL_MAX_MS), 0,
+				       CONN_TIMEOUT(CONFIG_CONN_SUPERVISION_TIMEOUT_MS)));
+	if (err) {
+		LOG_WRN("connection parameter update could not be requested, err %d", err);
+	}
+
+done:
+	bt_conn_unref(conn);
+	setup->conn = NULL;
+}
+
+void conn_setup_start(struct bt_conn *conn)
+{
+	conn_setup_t *setup = &setups[bt_conn_index(conn)];
+
+	if (setup->conn) {
+		// still pending from the previous connection
+		return;
+	}
+	setup->conn = bt_conn_ref(conn);
+	k_work_init(&setup->work, setup_work_handler);
+	k_work_submit_to_queue(&app_work_q, &setup->work);
+}
+
+static void phy_updated(struct bt_conn *conn, struct bt_conn_le_phy_info *param)
+{
+	LOG_INF("PHY updated, tx: 0x%02x, rx: 0x%02x", param->tx_phy, param->rx_phy);
+}
+
+static void data_len_updated(struct bt_conn *conn, struct bt_conn_le_data_len_info *info)
+{
+	LOG_INF("data length updated, tx: %u bytes, rx: %u bytes", info->tx_max_len,
+		info->rx_max_len);
+}
+
+static void param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency,
+			  uint16_t timeout)
+{
+	LOG_INF("connection parameters updated, interval: %u.%02ums, latency: %u, timeout: %ums",
+		interval * 5 / 4, (interval * 125) % 100, latency, timeout * 10);
+}
+
+BT_CONN_CB_DEFINE(conn_setup_callbacks) = {
+	.le_phy_updated = phy_updated,
+	.le_data_len_updated = data_len_updated,
+	.le_param_updated = param_updated,
+};
+
+static void att_mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+	LOG_INF("ATT MTU updated, tx: %u, rx: %u", tx, rx);
+}
+
+static struct bt_gatt_cb gatt_callbacks = {
+	.att_mtu_updated = att_mtu_updated,
+};
+
+void init_conn_setup(void)
+{
+	bt_gatt_cb_register(&gatt_callbacks);
+}
@@ -0,0 +1,41 @@
+/**
+ * @file
+ * @brief Connection setup for high throughput transfers.
+ *
+ * Right after a connection has been established, the 2M PHY, the maximum data length (251 byte
+ * PDUs), the largest ATT MTU and a short connection interval (CONFIG_CONN_INTERVAL_*) are
+ * requested. All requests are asynchronous, the central may reject any of them, the negotiated
+ * values are logged once they are known. Connections established on the coded PHY keep it, as
+ * switching to the 2M PHY would most likely drop them.
+ */
+
+#ifndef CONN_SETUP_H
+#define CONN_SETUP_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include <autoconf.h>
+
+#include "scheduler.h"
+
+// connection interval in units of 1.25ms, supervision timeout in units of 10ms
+#define CONN_INTERVAL(_ms) ((_ms) * 4 / 5)
+#define CONN_TIMEOUT(_ms)  ((_ms) / 10)
+
+/**
+ * @brief register the callbacks logging the negotiated values, must be called after bt_enable().
+ */
+void init_conn_setup(void);
+
+/**
+ * @brief request the throughput connection parameters for the given connection.
+ *
+ * Can be called from the connected callback, the requests are sent from the application work
+ * queue.
+ */
+void conn_setup_start(struct bt_conn *conn);
+
+#endif // CONN_SETUP_H
@@ -0,0 +1,226 @@
+#include "dht.h"
+
+LOG_MODULE_REGISTER(dht);
+
+#define DHT_NODE DT_COMPAT_GET_ANY_STATUS_OKAY(muuvi_dht)
+
+// response start, one falling edge per bit, end of transmission
+#define DHT_BITS             40
+#define DHT_EDGES            (DHT_BITS + 2)
+// start signal, the line has to be pulled low for at least 18ms (DHT11) or 1ms (DHT22)
+#define DHT11_START_MS       20
+#define DHT22_START_MS       2
+#define DHT11_MIN_INTERVAL   1000
+#define DHT22_MIN_INTERVAL   2000
+// complete response takes ~5ms
+#define DHT_RESPONSE_TIMEOUT K_MSEC(10)
+// time between two falling edges: 50us low + 26-28us high (0) or 70us high (1)
+#define DHT_BIT_MIN_US       60
+#define DHT_BIT_THRESHOLD_US 100
+#define DHT_BIT_MAX_US       150
+
+static const uint32_t pin = NRF_DT_GPIOS_TO_PSEL(DHT_NODE, dio_gpios);
+static const bool is_dht22 = DT_PROP(DHT_NODE, dht22);
+
+static const nrfx_timer_t timer = NRFX_TIMER_INSTANCE(2);
+// counts the falling edges in hardware, forked from the capture PPI channel
+static const nrfx_timer_t counter = NRFX_TIMER_INSTANCE(3);
+static const nrfx_gpiote_t gpiote = NRFX_GPIOTE_INSTANCE(0);
+
+// captured timestamps of the falling edges in us
+static uint32_t edges[DHT_EDGES];
+static volatile size_t edge_count;
+// an edge arrived before the capture of the previous one has been copied
+static volatile bool edges_missed;
+static K_SEM_DEFINE(response_sem, 0, 1);
+
+static void timer_handler(nrf_timer_event_t event_type, void *context)
+{
+	// no timer events are enabled, the timers are only used for capturing and counting
+}
+
+// falling edge, the timer value has already been captured and the edge counted by PPI
+static void gpiote_handler(nrfx_gpiote_pin_t trigger_pin, nrfx_gpiote_trigger_t trigger,
+			   void *context)
+{
+	if (edge_count >= DHT_EDGES || edges_missed) {
+		return;
+	}
+	uint32_t captured = nrfx_timer_capture_get(&timer, NRF_TIMER_CC_CHANNEL0);
+	// read after the capture: if another edge has been counted, the capture register may
+	// already hold its timestamp and the response can't be decoded
+	if (nrfx_timer_capture(&counter, NRF_TIMER_CC_CHANNEL0) != edge_count + 1) {
+		edges_missed = true;
+		k_sem_give(&response_sem);
+		return;
+	}
+	edges[edge_count++] = captured;
+	if (edge_count == DHT_EDGES) {
+		k_sem_give(&response_sem);
+	}
+}
+
+static int decode(dht_values_t *values)
+{
+	uint8_t data[DHT_BITS / 8] = {0};
+
+	for (int i = 0; i < DHT_BITS; i++) {
+		uint32_t duration = edges[i + 2] - edges[i + 1];
+		if (duration < DHT_BIT_MIN_US || duration > DHT_BIT_MAX_US) {
+			LOG_DBG("invalid duration of bit %d: %uus", i, duration);
+			return -EIO;
+		}
+		if (duration > DHT_BIT_THRESHOLD_US) {
+			data[i / 8] |= BIT(7 - (i % 8));
+		}
+	}
+
+	if (((data[0] + data[1] + data[2] + data[3]) & 0xFF) != data[4]) {
+		LOG_DBG("checksum mismatch");
+		return -EIO;
+	}
+
+	if (is_dht22) {
+		values->humidity = (data[0] << 8) | data[1];
+		values->temperature = ((data[2] & 0x7F) << 8) | data[3];
+		if (data[2] & 0x80) {
+			values->temperature = -values->temperature;
+		}
+	} else {
+		// integral and decimal part, the sign is in the msb of the decimal temperature part
+		values->humidity = data[0] * 10 + data[1];
+		values->temperature = data[2] * 10 + (data[3] & 0x7F);
+		if (data[3] & 0x80) {
+			values->temperature = -values->temperature;
+		}
+	}
+	return 0;
+}
+
+int dht_read(dht_values_t *values)
+{
+	int err;
+
+	// start signal: pull the line low (open drain)
+	nrf_gpio_cfg(pin, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_DISCONNECT,
+		     NRF_GPIO_PIN_PULLUP, NRF_GPIO_PIN_S0D1, NRF_GPIO_PIN_NOSENSE);
+	nrf_gpio_pin_clear(pin);
+	k_msleep(is_dht22 ? DHT22_START_MS : DHT11_START_MS);
+
+	edge_count = 0;
+	edges_missed = false;
+	k_sem_reset(&response_sem);
+	nrfx_timer_clear(&timer);
+	nrfx_timer_clear(&counter);
+	nrfx_timer_enable(&timer);
+	nrfx_timer_enable(&counter);
+
+	// release the line and capture the falling edges of the response
+	nrf_gpio_cfg_input(pin, NRF_GPIO_PIN_PULLUP);
+	nrfx_gpiote_trigger_enable(&gpiote, pin, true);
+
+	err = k_sem_take(&response_sem, DHT_RESPONSE_TIMEOUT);
+
+	nrfx_gpiote_trigger_disable(&gpiote, pin);
+	nrfx_timer_disable(&timer);
+	uint32_t counted = nrfx_timer_capture(&counter, NRF_TIMER_CC_CHANNEL0);
+	nrfx_timer_disable(&counter);
+
+	if (edges_missed) {
+		// interrupt latency, not the sensor: fail fast instead of decoding shifted bits
+		perf_inc(PERF_DHT_MISSED_EDGES);
+		LOG_DBG("missed edge, %d edges captured, %u counted", edge_count, counted);
+		return -EIO;
+	}
+	if (err) {
+		LOG_DBG("incomplete response, %d of %d edges", edge_count, DHT_EDGES);
+		return -ETIMEDOUT;
+	}
+	return decode(values);
+}
+
+int dht_min_interval_ms(void)
+{
+	return is_dht22 ? DHT22_MIN_INTERVAL : DHT11_MIN_INTERVAL;
+}
+
+int dht_init(void)
+{
+	nrfx_err_t nrfx_err;
+	uint8_t gpiote_channel;
+	uint8_t ppi_channel;
+
+	LOG_INF("initializing %s on pin %d...", is_dht22 ? "DHT22" : "DHT11", pin);
+
+#ifdef CONFIG_PM_DEVICE_RUNTIME
+	// the LED module suspends its GPIO port while LED1 is off (led.h), hold a reference, so the
+	// port stays active if it is shared, enabling runtime PM twice is a no-op
+	const struct device *port = DEVICE_DT_GET(DT_GPIO_CTLR(DHT_NODE, dio_gpios));
+	int err = pm_device_runtime_enable(port);
+	if (!err) {
+		err = pm_device_runtime_get(port);
+	}
+	if (err) {
+		LOG_ERR("GPIO port could not be resumed, err %d", err);
+		return err;
+	}
+#endif
+
+	// 1MHz timer, each tick is 1us
+	nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG(NRFX_MHZ_TO_HZ(1));
+	timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	nrfx_err = nrfx_timer_init(&timer, &timer_config, timer_handler);
+	if (nrfx_err != NRFX_SUCCESS) {
+		LOG_ERR("timer init failed, err 0x%08x", nrfx_err);
+		return -EBUSY;
+	}
+
+	nrfx_timer_config_t counter_config = NRFX_TIMER_DEFAULT_CONFIG(NRFX_MHZ_TO_HZ(1));
+	counter_config.mode = NRF_TIMER_MODE_LOW_POWER_COUNTER;
+	counter_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	nrfx_err = nrfx_timer_init(&counter, &counter_config, timer_handler);
+	if (nrfx_err != NRFX_SUCCESS) {
+		LOG_ERR("counter init failed, err 0x%08x", nrfx_err);
+		return -EBUSY;
+	}
+
+	nrfx_err = nrfx_gpiote_channel_alloc(&gpiote, &gpiote_channel);
+	if (nrfx_err != NRFX_SUCCESS) {
+		LOG_ERR("no GPIOTE channel available, err 0x%08x", nrfx_err);
+		return -ENOMEM;
+	}
+	static const nrf_gpio_pin_pull_t pull = NRF_GPIO_PIN_PULLUP;
+	nrfx_gpiote_trigger_config_t trigger_config = {
+		.trigger = NRFX_GPIOTE_TRIGGER_HITOLO,
+		.p_in_channel = &gpiote_channel,
+	};
+	nrfx_gpiote_handler_config_t handler_config = {
+		.handler = gpiote_handler,
+	};
+	nrfx_gpiote_input_pin_config_t input_config = {
+		.p_pull_config = &pull,
+		.p_trigger_config = &trigger_config,
+		.p_handler_config = &handler_config,
+	};
+	nrfx_err = nrfx_gpiote_input_configure(&gpiote, pin, &input_config);
+	if (nrfx_err != NRFX_SUCCESS) {
+		LOG_ERR("GPIOTE input config failed, err 0x%08x", nrfx_err);
+		return -EIO;
+	}
+
+	// falling edge -> capture the timer value and count the edge
+	nrfx_err = nrfx_gppi_channel_alloc(&ppi_channel);
+	if (nrfx_err != NRFX_SUCCESS) {
+		LOG_ERR("no PPI channel available, err 0x%08x", nrfx_err);
+		return -ENOMEM;
+	}
+	nrfx_gppi_channel_endpoints_setup(
+		ppi_channel, nrfx_gpiote_in_event_address_get(&gpiote, pin),
+		nrfx_timer_task_address_get(&timer, NRF_TIMER_TASK_CAPTURE0));
+	nrfx_gppi_fork_endpoint_setup(ppi_channel,
+				      nrfx_timer_task_address_get(&counter, NRF_TIMER_TASK_COUNT));
+	nrfx_gppi_channels_enable(BIT(ppi_channel));
+
+	LOG_INF("DHT initialized");
+	return 0;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file
+ * @brief Hardware timed DHT11 / DHT22 driver.
+ *
+ * After the start signal, the sensor answers with a falling edge, followed by one falling edge per
+ * bit and a final falling edge. The time between two falling edges is ~78us for a 0 bit and ~120us
+ * for a 1 bit. Each falling edge triggers a GPIOTE event, which is connected via PPI to the
+ * capture task of a free running 1MHz TIMER. The interrupt handler only has to copy the captured
+ * value before the next edge arrives, the timing itself is never affected by interrupt latency.
+ * The same PPI channel forks to the COUNT task of a second TIMER in counter mode, so an edge that
+ * arrives before the handler copied the previous capture (e.g. during a long radio interrupt) is
+ * detected: the read fails with -EIO and PERF_DHT_MISSED_EDGES is incremented, instead of
+ * decoding shifted bits.
+ */
+
+#ifndef DHT_H
+#define DHT_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device_runtime.h>
+
+#include <soc.h>
+#include <hal/nrf_gpio.h>
+#include <nrfx_timer.h>
+#include <nrfx_gpiote.h>
+#include <helpers/nrfx_gppi.h>
+
+#include "perf.h"
+
+typedef struct {
+	// temperature in 0.1 degree steps
+	int16_t temperature;
+	// humidity in 0.1% steps
+	uint16_t humidity;
+} dht_values_t;
+
+/**
+ * @brief set up the timer, GPIOTE and PPI resources used to read the sensor.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int dht_init(void);
+
+/**
+ * @brief read the sensor once.
+ *
+ * Blocks (sleeping) for the start signal and the ~5ms response of the sensor.
+ *
+ * @return 0 on success, -ETIMEDOUT if the sensor did not respond completely, -EIO on an invalid
+ * response or checksum or if an edge has been missed
+ */
+int dht_read(dht_values_t *values);
+
+/**
+ * @brief minimum time between two reads in ms, as required by the sensor.
+ */
+int dht_min_interval_ms(void);
+
+#endif // DHT_H
@@ -0,0 +1,55 @@
+#include "filter.h"
+
+#include <string.h>
+
+int32_t filter_median(const int32_t *values, size_t count)
+{
+	int32_t sorted[FILTER_MEDIAN_MAX_COUNT];
+
+	if (count > FILTER_MEDIAN_MAX_COUNT) {
+		count = FILTER_MEDIAN_MAX_COUNT;
+	}
+	// insertion sort, the number of values is tiny
+	for (size_t i = 0; i < count; i++) {
+		int32_t value = values[i];
+		size_t j = i;
+		while (j > 0 && sorted[j - 1] > value) {
+			sorted[j] = sorted[j - 1];
+			j--;
+		}
+		sorted[j] = value;
+	}
+	return sorted[(count - 1) / 2];
+}
+
+int32_t filter_mean(const int32_t *values, size_t count)
+{
+	int64_t sum = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		sum += values[i];
+	}
+	return (int32_t)(sum / (int64_t)count);
+}
+
+int32_t filter_ema(filter_ema_t *ema, int32_t value, uint8_t shift)
+{
+	int32_t scaled = value * (1 << FILTER_EMA_FRACTION_BITS);
+
+	if (!ema->initialized || shift == 0) {
+		ema->state = scaled;
+		ema->initialized = true;
+	} else {
+		ema->state += (scaled - ema->state) / (1 << shift);
+	}
+	// round to the nearest integer
+	int32_t half = 1 << (FILTER_EMA_FRACTION_BITS - 1);
+	return (ema->state >= 0 ? ema->state + half : ema->state - half) /
+	       (1 << FILTER_EMA_FRACTION_BITS);
+}
+
+void filter_ema_reset(filter_ema_t *ema)
+{
+	ema->state = 0;
+	ema->initialized = false;
+}
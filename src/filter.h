@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @brief Integer fixed-point filters for the sensor measurements.
+ *
+ * All filters work on integers only, so no FPU is required.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// maximum number of values the median filter can handle
+#define FILTER_MEDIAN_MAX_COUNT 15
+// fractional bits of the EMA state
+#define FILTER_EMA_FRACTION_BITS 8
+
+typedef struct {
+	// filtered value with FILTER_EMA_FRACTION_BITS fractional bits
+	int32_t state;
+	bool initialized;
+} filter_ema_t;
+
+/**
+ * @brief median of the given values (the lower one of the two middle values for even counts).
+ *
+ * @param values values to filter, at most FILTER_MEDIAN_MAX_COUNT, not modified
+ * @param count number of values, must be > 0
+ */
+int32_t filter_median(const int32_t *values, size_t count);
+
+/**
+ * @brief mean of the given values, rounded towards zero.
+ *
+ * @param values values to filter
+ * @param count number of values, must be > 0
+ */
+int32_t filter_mean(const int32_t *values, size_t count);
+
+/**
+ * @brief exponential moving average with a weight of 1 / 2^shift for the new value.
+ *
+ * The first value initializes the filter, a shift of 0 disables filtering.
+ *
+ * @return filtered value, rounded to the nearest integer
+ */
+int32_t filter_ema(filter_ema_t *ema, int32_t value, uint8_t shift);
+
+/**
+ * @brief reset the given EMA filter, the next value initializes it again.
+ */
+void filter_ema_reset(filter_ema_t *ema);
+
+#endif // FILTER_H
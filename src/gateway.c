@@ -0,0 +1,269 @@
+#include "gateway.h"
+
+LOG_MODULE_REGISTER(gateway);
+
+#define TABLE_MASK (CONFIG_GATEWAY_TABLE_SIZE - 1)
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_GATEWAY_TABLE_SIZE), "table size must be a power of two");
+
+// a frame always fits into a single notification with the maximum MTU
+#define GATEWAY_FRAME_MAX_RECORDS                                                                  \
+	((CONFIG_BT_L2CAP_TX_MTU - 3 - GATEWAY_FRAME_OVERHEAD) / GATEWAY_RECORD_LEN)
+#define GATEWAY_FRAME_MAX_LEN                                                                      \
+	(GATEWAY_FRAME_OVERHEAD + GATEWAY_FRAME_MAX_RECORDS * GATEWAY_RECORD_LEN)
+BUILD_ASSERT(GATEWAY_FRAME_MAX_RECORDS > 0, "BT_L2CAP_TX_MTU too small for a gateway record");
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME        16777619u
+
+typedef struct {
+	uint8_t mac[RUUVI_MAC_LEN];
+	uint16_t sequence_number;
+	// checksum of the payload, for tags which do not send sequence numbers
+	uint16_t crc;
+	// uptime in seconds + 1, 0 marks an unused slot
+	uint32_t last_seen;
+} gateway_entry_t;
+
+typedef struct {
+	const uint8_t (*records)[GATEWAY_RECORD_LEN];
+	size_t count;
+} gateway_batch_t;
+
+// only accessed from the scan callback (BT RX thread)
+static gateway_entry_t table[CONFIG_GATEWAY_TABLE_SIZE];
+
+K_MSGQ_DEFINE(record_q, GATEWAY_RECORD_LEN, CONFIG_GATEWAY_QUEUE_LEN, 1);
+
+// only accessed from the application work queue
+static uint8_t records[CONFIG_GATEWAY_QUEUE_LEN][GATEWAY_RECORD_LEN];
+static uint8_t frame[GATEWAY_FRAME_MAX_LEN];
+
+#ifdef CONFIG_GATEWAY_TRANSPORT_UART
+static const struct device *const uart = DEVICE_DT_GET(DT_CHOSEN(muuvi_gateway_uart));
+#endif
+
+static void flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_handler);
+
+static void adv_work_handler(struct k_work *work);
+static K_WORK_DEFINE(adv_work, adv_work_handler);
+
+static uint32_t hash_mac(const uint8_t *mac)
+{
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	for (int i = 0; i < RUUVI_MAC_LEN; i++) {
+		hash = (hash ^ mac[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+// records the sample of the given tag, returns true if it has not been seen before
+static bool table_update(const ruuvi_rawv2_t *data, uint16_t crc)
+{
+	uint32_t now = k_uptime_seconds() + 1;
+	uint32_t index = hash_mac(data->mac) & TABLE_MASK;
+	gateway_entry_t *free_entry = NULL;
+
+	for (int i = 0; i < CONFIG_GATEWAY_TABLE_SIZE; i++, index = (index + 1) & TABLE_MASK) {
+		gateway_entry_t *entry = &table[index];
+
+		if (!entry->last_seen) {
+			// end of the probe sequence, the tag is not in the table
+			if (!free_entry) {
+				free_entry = entry;
+			}
+			break;
+		}
+		if (memcmp(entry->mac, data->mac, RUUVI_MAC_LEN) == 0) {
+			bool duplicate = entry->sequence_number == data->sequence_number &&
+					 (data->sequence_number != RUUVI_SEQUENCE_NA || entry->crc == crc);
+			entry->sequence_number = data->sequence_number;
+			entry->crc = crc;
+			entry->last_seen = now;
+			return !duplicate;
+		}
+		// slots of silent tags are reused, but never emptied, so probe sequences stay intact
+		if (!free_entry && now - entry->last_seen > CONFIG_GATEWAY_ENTRY_TIMEOUT_SEC) {
+			free_entry = entry;
+		}
+	}
+
+	if (!free_entry) {
+		LOG_DBG("table full, forwarding without de-duplication");
+		return true;
+	}
+	memcpy(free_entry->mac, data->mac, RUUVI_MAC_LEN);
+	free_entry->sequence_number = data->sequence_number;
+	free_entry->crc = crc;
+	free_entry->last_seen = now;
+	return true;
+}
+
+static bool find_manufacturer_data(struct bt_data *data, void *user_data)
+{
+	struct bt_data *manufacturer_data = user_data;
+
+	if (data->type != BT_DATA_MANUFACTURER_DATA) {
+		return true;
+	}
+	*manufacturer_data = *data;
+	return false;
+}
+
+static void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t adv_type,
+		    struct net_buf_simple *ad)
+{
+	struct bt_data manufacturer_data = {0};
+	ruuvi_rawv2_t data;
+	uint8_t record[GATEWAY_RECORD_LEN];
+
+	bt_data_parse(ad, find_manufacturer_data, &manufacturer_data);
+	if (ruuvi_rawv2_decode(manufacturer_data.data, manufacturer_data.data_len, &data)) {
+		return;
+	}
+	perf_inc(PERF_GATEWAY_RECEIVED);
+
+	uint16_t crc = crc16_ccitt(0xFFFF, manufacturer_data.data, RUUVI_RAWV2_LEN);
+	if (!table_update(&data, crc)) {
+		return;
+	}
+
+	record[0] = (uint8_t)rssi;
+	memcpy(&record[1], &manufacturer_data.data[2], RUUVI_RAWV2_LEN - 2);
+	if (k_msgq_put(&record_q, record, K_NO_WAIT)) {
+		perf_inc(PERF_GATEWAY_DROPPED);
+		return;
+	}
+	// send full frames right away, everything else is sent with the periodic flush
+	if (k_msgq_num_used_get(&record_q) >= GATEWAY_FRAME_MAX_RECORDS) {
+		k_work_reschedule_for_queue(&app_work_q, &flush_work, K_NO_WAIT);
+	}
+}
+
+static size_t build_frame(const uint8_t (*frame_records)[GATEWAY_RECORD_LEN], size_t count)
+{
+	size_t len = 0;
+
+	frame[len++] = GATEWAY_FRAME_START;
+	frame[len++] = count;
+	memcpy(&frame[len], frame_records, count * GATEWAY_RECORD_LEN);
+	len += count * GATEWAY_RECORD_LEN;
+	// CRC-16/MCRF4XX (reflected, init 0xFFFF, no final XOR), see gateway.h
+	sys_put_be16(crc16_ccitt(0xFFFF, frame, len), &frame[len]);
+	return len + 2;
+}
+
+#ifdef CONFIG_GATEWAY_TRANSPORT_UART
+
+static void send_batch(const gateway_batch_t *batch)
+{
+	for (size_t i = 0; i < batch->count; i += GATEWAY_FRAME_MAX_RECORDS) {
+		size_t len = build_frame(&batch->records[i],
+					 MIN(GATEWAY_FRAME_MAX_RECORDS, batch->count - i));
+		for (size_t j = 0; j < len; j++) {
+			uart_poll_out(uart, frame[j]);
+		}
+	}
+}
+
+#else
+
+static void send_nus_cb(struct bt_conn *conn, void *user_data)
+{
+	const gateway_batch_t *batch = user_data;
+	struct bt_conn_info info;
+
+	if (bt_conn_get_info(conn, &info) || info.state != BT_CONN_STATE_CONNECTED) {
+		return;
+	}
+	// frames are sized to the MTU of each connection
+	size_t mtu = bt_nus_get_mtu(conn);
+	size_t per_frame = mtu > GATEWAY_FRAME_OVERHEAD
+				   ? (mtu - GATEWAY_FRAME_OVERHEAD) / GATEWAY_RECORD_LEN
+				   : 0;
+	per_frame = MIN(per_frame, GATEWAY_FRAME_MAX_RECORDS);
+	if (!per_frame) {
+		LOG_DBG("MTU %d too small for a gateway frame", mtu);
+		return;
+	}
+
+	for (size_t i = 0; i < batch->count; i += per_frame) {
+		size_t len = build_frame(&batch->records[i], MIN(per_frame, batch->count - i));
+		int err = bt_nus_send(conn, frame, len);
+		if (err) {
+			// -EINVAL: notifications are not enabled by this client
+			if (err != -EINVAL) {
+				LOG_WRN("frame could not be sent, err %d", err);
+			}
+			return;
+		}
+	}
+}
+
+static void send_batch(const gateway_batch_t *batch)
+{
+	bt_conn_foreach(BT_CONN_TYPE_LE, send_nus_cb, (void *)batch);
+}
+
+#endif // CONFIG_GATEWAY_TRANSPORT_UART
+
+static void flush_work_handler(struct k_work *work)
+{
+	gateway_batch_t batch = {.records = records, .count = 0};
+
+	while (batch.count < CONFIG_GATEWAY_QUEUE_LEN &&
+	       !k_msgq_get(&record_q, records[batch.count], K_NO_WAIT)) {
+		perf_inc(PERF_GATEWAY_FORWARDED);
+		batch.count++;
+	}
+	if (batch.count) {
+		LOG_DBG("forwarding %d samples", batch.count);
+		send_batch(&batch);
+	}
+
+	k_work_schedule_for_queue(&app_work_q, &flush_work, K_MSEC(CONFIG_GATEWAY_FLUSH_MS));
+}
+
+// the gateway only advertises to be connectable, the payload stays "not available"
+static void adv_work_handler(struct k_work *work)
+{
+	publish_advertisement_data();
+}
+
+int init_gateway(void)
+{
+	int err;
+
+#ifdef CONFIG_GATEWAY_TRANSPORT_UART
+	if (!device_is_ready(uart)) {
+		LOG_ERR("gateway UART is not ready");
+		return -ENODEV;
+	}
+#ifdef CONFIG_USB_DEVICE_STACK
+	err = usb_enable(NULL);
+	if (err && err != -EALREADY) {
+		LOG_ERR("USB could not be enabled, err %d", err);
+		return err;
+	}
+#endif
+#endif
+
+	// continuous passive scanning, duplicates have to be reported to see new samples
+	static const struct bt_le_scan_param scan_params = {
+		.type = BT_LE_SCAN_TYPE_PASSIVE,
+		.options = BT_LE_SCAN_OPT_NONE,
+		.interval = BT_GAP_SCAN_FAST_INTERVAL,
+		.window = BT_GAP_SCAN_FAST_INTERVAL,
+	};
+	err = bt_le_scan_start(&scan_params, scan_cb);
+	if (err) {
+		LOG_ERR("scanning could not be started, err %d", err);
+		return err;
+	}
+
+	LOG_INF("gateway started, tracking up to %d tags", CONFIG_GATEWAY_TABLE_SIZE);
+	k_work_submit_to_queue(&app_work_q, &adv_work);
+	k_work_schedule_for_queue(&app_work_q, &flush_work, K_MSEC(CONFIG_GATEWAY_FLUSH_MS));
+	return 0;
+}
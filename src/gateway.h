@@ -0,0 +1,64 @@
+/**
+ * @file
+ * @brief Gateway role: forward the RAWv2 advertisements of nearby tags.
+ *
+ * The gateway scans passively and decodes the manufacturer data of every advertisement with the
+ * same codec as the advertiser (ruuvi_codec.h). Tags advertise the same sample many times, so each
+ * sample is checked against an open addressing table of the last sequence number per MAC (linear
+ * probing, FNV-1a hash of the MAC). Tags without sequence numbers are de-duplicated by a checksum of
+ * their payload instead. Only new samples are queued and forwarded in batched frames:
+ *
+ * | Offset | Length      | Content                                                           |
+ * | ------ | ----------- | ----------------------------------------------------------------- |
+ * | 0      | 1           | GATEWAY_FRAME_START (0x47)                                        |
+ * | 1      | 1           | number of records                                                 |
+ * | 2      | 25 / record | RSSI (int8), RAWv2 payload without company id (format 5 ... MAC)  |
+ * | 2 + n  | 2           | CRC-16/MCRF4XX of the preceding bytes, big endian                 |
+ *
+ * The CRC is Zephyr's crc16_ccitt() with a seed of 0xFFFF, i.e. CRC-16/MCRF4XX: polynomial 0x1021,
+ * reflected input and output, init 0xFFFF, no final XOR. The check value of "123456789" is 0x6F91
+ * (not 0x29B1 of CRC-16/CCITT-FALSE).
+ *
+ * Over NUS, every frame is a single notification sized to the MTU of the connection. Over a UART
+ * (e.g. USB CDC ACM), frames are written back to back and re-synchronized by the start byte and
+ * the CRC.
+ */
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/usb/usb_device.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gap.h>
+#include <bluetooth/services/nus.h>
+
+#include <string.h>
+#include <autoconf.h>
+
+#include "ble.h"
+#include "perf.h"
+#include "ruuvi_codec.h"
+#include "scheduler.h"
+
+#define GATEWAY_FRAME_START    0x47
+// RSSI and RAWv2 payload without the company id
+#define GATEWAY_RECORD_LEN     (1 + RUUVI_RAWV2_LEN - 2)
+// start byte, record count and CRC
+#define GATEWAY_FRAME_OVERHEAD 4
+
+/**
+ * @brief start scanning for tags and forwarding their samples.
+ *
+ * Must be called after init_ble() and init_scheduler(), which starts the application work queue.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int init_gateway(void);
+
+#endif // GATEWAY_H
@@ -2,50 +2,66 @@
 
 LOG_MODULE_REGISTER(gatt);
 
-static ssize_t dis_tx_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
-			 uint16_t len, uint16_t offset)
+// longest DIS value read from the parameters, the runtime ones are at most PARAMS_STRING_MAX_LEN
+#define DIS_VALUE_MAX_LEN 64
+
+static ssize_t dis_send(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+			uint16_t len, uint16_t offset, const char *str)
 {
 	set_led_pattern(&PATTERN_DIS_TX_RECEIVED);
-	char client_addr[BT_ADDR_LE_STR_LEN];
-	bt_addr_le_t addr;
-	bt_addr_le_copy(&addr, bt_conn_get_dst(conn));
-	bt_addr_le_to_str_without_type(&addr, client_addr, sizeof(client_addr));
 
-	const char *str = attr->user_data;
 	// todo: log characteristic UUID if possible
-	LOG_INF("DIS TX: sending value '%s' to '%s'", str, client_addr);
+	LOG_INF("DIS TX: sending value '%s' to '" ADDR_FMT "'", str,
+		ADDR_ARGS(bt_conn_get_dst(conn)));
 
 	return bt_gatt_attr_read(conn, attr, buf, len, offset, str, strlen(str));
 }
 
+// values which can be changed at runtime, the user data is their parameter id
+static ssize_t dis_tx_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+			 uint16_t len, uint16_t offset)
+{
+	char str[DIS_VALUE_MAX_LEN];
+
+	params_get_string((param_id_t)(uintptr_t)attr->user_data, str, sizeof(str));
+	return dis_send(conn, attr, buf, len, offset, str);
+}
+
+// values fixed at build time, the user data is the string itself
+static ssize_t dis_static_tx_cb(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf,
+				uint16_t len, uint16_t offset)
+{
+	return dis_send(conn, attr, buf, len, offset, attr->user_data);
+}
+
+#define DIS_PARAM(_id) ((void *)(uintptr_t)(_id))
+
 BT_GATT_SERVICE_DEFINE(
 	dis_svc, BT_GATT_PRIMARY_SERVICE(BT_UUID_DIS),
 
 	BT_GATT_CHARACTERISTIC(BT_UUID_DIS_MANUFACTURER_NAME, BT_GATT_CHRC_READ, BT_GATT_PERM_READ,
-			       dis_tx_cb, NULL, CONFIG_MANUFACTURER_NAME),
+			       dis_tx_cb, NULL, DIS_PARAM(PARAM_MANUFACTURER_NAME)),
 
 	BT_GATT_CHARACTERISTIC(BT_UUID_DIS_MODEL_NUMBER, BT_GATT_CHRC_READ, BT_GATT_PERM_READ,
-			       dis_tx_cb, NULL, CONFIG_MODEL_NUMBER),
+			       dis_tx_cb, NULL, DIS_PARAM(PARAM_MODEL_NUMBER)),
 
 	BT_GATT_CHARACTERISTIC(BT_UUID_DIS_SERIAL_NUMBER, BT_GATT_CHRC_READ, BT_GATT_PERM_READ,
-			       dis_tx_cb, NULL, CONFIG_SERIAL_NUMBER),
+			       dis_tx_cb, NULL, DIS_PARAM(PARAM_SERIAL_NUMBER)),
 
 	BT_GATT_CHARACTERISTIC(BT_UUID_DIS_FIRMWARE_REVISION, BT_GATT_CHRC_READ, BT_GATT_PERM_READ,
-			       dis_tx_cb, NULL, CONFIG_FW_REV),
+			       dis_static_tx_cb, NULL, CONFIG_FW_REV),
 
 	BT_GATT_CHARACTERISTIC(BT_UUID_DIS_HARDWARE_REVISION, BT_GATT_CHRC_READ, BT_GATT_PERM_READ,
-			       dis_tx_cb, NULL, CONFIG_HW_REV), );
+			       dis_tx_cb, NULL, DIS_PARAM(PARAM_HW_REV)), );
 
-// NUS RX callback handler
+// NUS RX callback handler, the data is not NUL terminated
 static void nus_rx_cb(struct bt_conn *conn, const uint8_t *const data, uint16_t len)
 {
 	set_led_pattern(&PATTERN_NUS_RX_RECEIVED);
-	char client_addr[BT_ADDR_LE_STR_LEN];
-	bt_addr_le_t addr;
-	bt_addr_le_copy(&addr, bt_conn_get_dst(conn));
-	bt_addr_le_to_str_without_type(&addr, client_addr, sizeof(client_addr));
+	LOG_INF("NUS RX: received %u bytes", len);
+	LOG_HEXDUMP_DBG(data, len, "NUS RX");
 
-	LOG_INF("NUS RX: received value '%s' from '%s'", data, client_addr);
+	nus_cmd_dispatch(conn, data, len);
 }
 
 void init_gatt_services(void)
@@ -2,6 +2,7 @@
 #define GATT_H
 
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/bluetooth/gatt.h>
 #include <bluetooth/services/nus.h>
 #include <zephyr/bluetooth/bluetooth.h>
@@ -9,6 +10,8 @@
 #include <autoconf.h>
 
 #include "led.h"
+#include "nus_cmd.h"
+#include "params.h"
 #include "utils.h"
 
 void init_gatt_services(void);
@@ -0,0 +1,396 @@
+#include "history.h"
+
+LOG_MODULE_REGISTER(history);
+
+// NVS ids below 0x8000 are not used by the settings backend
+#define HISTORY_ID_HEAD       0x0100
+#define HISTORY_ID_BLOCK_BASE 0x0101
+// full record at the start of each block: timestamp, temperature and humidity
+#define BLOCK_HEADER_LEN      8
+// a record stores three varints, the time delta takes at most 5 bytes, the others 3 bytes
+#define RECORD_MAX_LEN        11
+// changed whenever the layout of the open block changes
+#define OPEN_BLOCK_MAGIC      0x4D754831
+
+BUILD_ASSERT(CONFIG_HISTORY_BLOCK_SIZE >= BLOCK_HEADER_LEN + RECORD_MAX_LEN,
+	     "history block size too small");
+
+// NVS instance of the settings subsystem
+static struct nvs_fs *fs;
+typedef struct {
+	uint32_t magic;
+	// sequence number of the block
+	uint32_t seq;
+	uint32_t len;
+	uint8_t data[CONFIG_HISTORY_BLOCK_SIZE];
+	uint32_t crc;
+} open_block_t;
+
+// sequence number of the block currently being written, the block id is derived from it
+static uint32_t head;
+// block currently being written, kept in retained (__noinit) RAM and only written to flash once it
+// is full, NVS has no in-place updates. It survives resets, a power loss loses it (history.h).
+static __noinit open_block_t open_block;
+// last record written, base for the next delta
+static history_record_t last_record;
+// device time at boot
+static uint32_t time_base;
+
+// state of a running log read, only accessed from the application work queue
+static struct {
+	struct bt_conn *conn;
+	bool started;
+	// difference between the client time and the device time
+	int64_t time_offset;
+	uint32_t start;
+	// sequence number of the next block to load
+	uint32_t seq;
+	size_t pos;
+	size_t len;
+	history_record_t record;
+	uint8_t block[CONFIG_HISTORY_BLOCK_SIZE];
+} reader;
+static atomic_t reader_busy = ATOMIC_INIT(0);
+
+static void read_work_handler(struct k_work *work);
+static K_WORK_DEFINE(read_work, read_work_handler);
+
+static inline uint16_t block_id(uint32_t seq)
+{
+	return HISTORY_ID_BLOCK_BASE + (seq % CONFIG_HISTORY_MAX_BLOCKS);
+}
+
+static inline uint32_t first_block(void)
+{
+	return head >= CONFIG_HISTORY_MAX_BLOCKS ? head - CONFIG_HISTORY_MAX_BLOCKS + 1 : 0;
+}
+
+static uint32_t open_block_crc(void)
+{
+	return crc32_ieee((const uint8_t *)&open_block, offsetof(open_block_t, crc));
+}
+
+static uint32_t device_time(void)
+{
+	return time_base + (uint32_t)(k_uptime_get() / MSEC_PER_SEC);
+}
+
+// zigzag encoding keeps small negative deltas short
+static size_t put_varint(uint8_t *buf, int32_t value)
+{
+	uint32_t v = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	size_t len = 0;
+
+	do {
+		buf[len] = v & 0x7F;
+		v >>= 7;
+		if (v) {
+			buf[len] |= 0x80;
+		}
+		len++;
+	} while (v);
+	return len;
+}
+
+// returns the number of bytes consumed, 0 if the varint is truncated
+static size_t get_varint(const uint8_t *buf, size_t len, int32_t *value)
+{
+	uint32_t v = 0;
+
+	for (size_t i = 0; i < len && i < 5; i++) {
+		v |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+		if (!(buf[i] & 0x80)) {
+			*value = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+// decode the record at pos (the block header at pos 0) on top of the given record, returns the
+// number of bytes consumed, 0 at the end of the block
+static size_t decode_record(const uint8_t *buf, size_t len, size_t pos, history_record_t *record)
+{
+	if (pos == 0) {
+		if (len < BLOCK_HEADER_LEN) {
+			return 0;
+		}
+		record->timestamp = sys_get_le32(&buf[0]);
+		record->temperature = sys_get_le16(&buf[4]);
+		record->humidity = sys_get_le16(&buf[6]);
+		return BLOCK_HEADER_LEN;
+	}
+
+	int32_t deltas[3];
+	size_t consumed = 0;
+	for (int i = 0; i < ARRAY_SIZE(deltas); i++) {
+		size_t n = get_varint(&buf[pos + consumed], len - pos - consumed, &deltas[i]);
+		if (!n) {
+			return 0;
+		}
+		consumed += n;
+	}
+	record->timestamp += deltas[0] + CONFIG_HISTORY_INTERVAL_SEC;
+	record->temperature += deltas[1];
+	record->humidity += deltas[2];
+	return consumed;
+}
+
+// decodes all records of a block into record, returns the length of the valid records
+static size_t decode_block(const uint8_t *buf, size_t len, history_record_t *record)
+{
+	size_t pos = 0;
+	size_t n;
+
+	while ((n = decode_record(buf, len, pos, record)) > 0) {
+		pos += n;
+	}
+	return pos;
+}
+
+static void block_start(const history_record_t *record)
+{
+	sys_put_le32(record->timestamp, &open_block.data[0]);
+	sys_put_le16(record->temperature, &open_block.data[4]);
+	sys_put_le16(record->humidity, &open_block.data[6]);
+	open_block.len = BLOCK_HEADER_LEN;
+}
+
+// append a record to the current block, returns false if the block is full
+static bool block_append(const history_record_t *record)
+{
+	uint8_t encoded[RECORD_MAX_LEN];
+	size_t len = 0;
+
+	// the time delta is stored relative to the history interval, so it usually fits into a
+	// single byte
+	len += put_varint(&encoded[len], (int32_t)(record->timestamp - last_record.timestamp) -
+						 CONFIG_HISTORY_INTERVAL_SEC);
+	len += put_varint(&encoded[len], record->temperature - last_record.temperature);
+	len += put_varint(&encoded[len], record->humidity - last_record.humidity);
+	if (open_block.len + len > sizeof(open_block.data)) {
+		return false;
+	}
+	memcpy(&open_block.data[open_block.len], encoded, len);
+	open_block.len += len;
+	return true;
+}
+
+// write the full open block to flash and continue with the next one, overwriting the oldest block
+static int block_close(void)
+{
+	ssize_t rc = nvs_write(fs, block_id(head), open_block.data, open_block.len);
+	if (rc < 0) {
+		LOG_ERR("history block could not be written, err %d", rc);
+		return rc;
+	}
+	// the head is only advanced once the block is written, so a power loss in between never
+	// leaves the head pointing past a block which is not in flash
+	head++;
+	rc = nvs_write(fs, HISTORY_ID_HEAD, &head, sizeof(head));
+	if (rc < 0) {
+		LOG_ERR("history head could not be written, err %d", rc);
+	}
+	open_block.seq = head;
+	open_block.len = 0;
+	return 0;
+}
+
+void history_log(const measurement_t *measurements)
+{
+	if (!fs) {
+		return;
+	}
+
+	if (measurements->temperature == MEASUREMENT_TEMPERATURE_NA ||
+	    measurements->humidity == MEASUREMENT_HUMIDITY_NA) {
+		return;
+	}
+
+	uint32_t now = device_time();
+	if (open_block.len > 0 && now - last_record.timestamp < CONFIG_HISTORY_INTERVAL_SEC) {
+		return;
+	}
+
+	history_record_t record = {
+		.timestamp = now,
+		.temperature = measurements->temperature,
+		.humidity = measurements->humidity,
+	};
+	// a full block which could not be written is retried with the next record, this one is
+	// dropped
+	if (open_block.len > 0 && !block_append(&record) && block_close()) {
+		return;
+	}
+	if (open_block.len == 0) {
+		block_start(&record);
+	}
+	open_block.crc = open_block_crc();
+	last_record = record;
+	LOG_DBG("history record added to block %u (%u bytes)", head, open_block.len);
+}
+
+// load the next block to read, the block currently being written is copied from RAM
+static void reader_load_block(void)
+{
+	ssize_t len;
+
+	if (reader.seq == head) {
+		memcpy(reader.block, open_block.data, open_block.len);
+		len = open_block.len;
+	} else {
+		len = nvs_read(fs, block_id(reader.seq), reader.block, sizeof(reader.block));
+	}
+	reader.len = len > 0 ? MIN(len, sizeof(reader.block)) : 0;
+	reader.pos = 0;
+	reader.seq++;
+}
+
+// append a log record to the pending NUS batch, returns 1 if a full batch has been sent
+static int reader_append(uint8_t endpoint, uint32_t timestamp, uint32_t value)
+{
+	uint8_t msg[RUUVI_LOG_MSG_LEN];
+
+	nus_msg_put(msg, RUUVI_ENDPOINT_ENVIRONMENTAL, endpoint, RUUVI_OP_LOG_VALUE_WRITE, timestamp,
+		    value);
+	return nus_send(reader.conn, msg, sizeof(msg));
+}
+
+static void reader_finish(int err)
+{
+	if (!err) {
+		// end of log marker
+		err = reader_append(RUUVI_ENDPOINT_ENVIRONMENTAL, UINT32_MAX, UINT32_MAX);
+		if (err >= 0) {
+			err = nus_flush(reader.conn);
+		}
+	}
+	if (err < 0) {
+		LOG_WRN("log read aborted, err %d", err);
+	} else {
+		LOG_INF("log read finished");
+	}
+	bt_conn_unref(reader.conn);
+	reader.conn = NULL;
+	atomic_clear(&reader_busy);
+}
+
+// sends a single batch of records per invocation and resubmits itself until the log is complete
+static void read_work_handler(struct k_work *work)
+{
+	int sent = 0;
+
+	if (!reader.started) {
+		reader.started = true;
+		reader.seq = first_block();
+	}
+
+	while (!sent) {
+		if (reader.pos >= reader.len) {
+			if (reader.seq > head) {
+				reader_finish(0);
+				return;
+			}
+			reader_load_block();
+			continue;
+		}
+
+		size_t n = decode_record(reader.block, reader.len, reader.pos, &reader.record);
+		if (!n) {
+			// end of block or corrupted record, skip the rest of the block
+			reader.pos = reader.len;
+			continue;
+		}
+		reader.pos += n;
+
+		uint32_t timestamp = reader.record.timestamp + reader.time_offset;
+		if (timestamp < reader.start) {
+			continue;
+		}
+		// the log uses 0.01 degree and 0.01% steps
+		int err = reader_append(RUUVI_ENDPOINT_TEMPERATURE, timestamp,
+					reader.record.temperature / 2);
+		if (err >= 0) {
+			sent = err;
+			err = reader_append(RUUVI_ENDPOINT_HUMIDITY, timestamp,
+					    reader.record.humidity / 4);
+		}
+		if (err < 0) {
+			reader_finish(err);
+			return;
+		}
+		sent |= err;
+	}
+	k_work_submit_to_queue(&app_work_q, &read_work);
+}
+
+int history_request_read(struct bt_conn *conn, uint32_t now, uint32_t start)
+{
+	if (!fs) {
+		return -ENODEV;
+	}
+	if (!atomic_cas(&reader_busy, 0, 1)) {
+		return -EBUSY;
+	}
+
+	reader.conn = bt_conn_ref(conn);
+	reader.started = false;
+	reader.time_offset = (int64_t)now - device_time();
+	reader.start = start;
+	reader.pos = 0;
+	reader.len = 0;
+	LOG_INF("log read of records since %u requested", start);
+	k_work_submit_to_queue(&app_work_q, &read_work);
+	return 0;
+}
+
+int init_history(void)
+{
+	int err;
+	LOG_INF("initializing measurement history...");
+	err = settings_subsys_init();
+	if (err) {
+		LOG_ERR("settings init failed, err %d", err);
+		return err;
+	}
+	err = settings_storage_get((void **)&fs);
+	if (err) {
+		LOG_ERR("settings storage not available, err %d", err);
+		fs = NULL;
+		return err;
+	}
+
+	if (nvs_read(fs, HISTORY_ID_HEAD, &head, sizeof(head)) != sizeof(head)) {
+		head = 0;
+	}
+	// restore the last record, the device time continues from there
+	size_t restored = 0;
+	if (open_block.magic == OPEN_BLOCK_MAGIC && open_block.crc == open_block_crc() &&
+	    open_block.seq == head && open_block.len <= sizeof(open_block.data)) {
+		open_block.len = decode_block(open_block.data, open_block.len, &last_record);
+		restored = open_block.len;
+	} else {
+		// first boot or power loss, the records of the open block are lost, continue after
+		// the last block in flash (the reader buffer is not in use yet)
+		LOG_INF("no open history block retained");
+		open_block.magic = OPEN_BLOCK_MAGIC;
+		open_block.seq = head;
+		open_block.len = 0;
+		if (head > 0) {
+			ssize_t len = nvs_read(fs, block_id(head - 1), reader.block,
+					       sizeof(reader.block));
+			if (len > 0) {
+				restored = decode_block(reader.block,
+							MIN(len, sizeof(reader.block)),
+							&last_record);
+			}
+		}
+	}
+	open_block.crc = open_block_crc();
+	if (restored > 0) {
+		time_base = last_record.timestamp;
+	}
+
+	LOG_INF("history initialized, %u blocks stored", head - first_block() + 1);
+	return 0;
+}
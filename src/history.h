@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief Measurement history stored in flash.
+ *
+ * Records are stored in blocks of CONFIG_HISTORY_BLOCK_SIZE bytes. Each block starts with a full
+ * record, every following record only stores the zigzag/varint encoded deltas to its predecessor,
+ * which usually takes 3 bytes per record. The blocks are kept as a ring buffer of
+ * CONFIG_HISTORY_MAX_BLOCKS entries in the NVS instance of the settings subsystem.
+ *
+ * NVS has no in-place updates, so the block currently being written is kept in retained (__noinit)
+ * RAM with a magic and a CRC32 and only written to flash once it is full, a single flash write per
+ * block. The open block survives resets, but a power loss loses its records: at most
+ * (CONFIG_HISTORY_BLOCK_SIZE - 8) / 3 + 1 records, 41 records or about 3.4 hours with the defaults.
+ *
+ * Timestamps are kept in "device seconds", which continue counting from the last stored record
+ * after a reboot. They are converted to real time when the log is read, based on the current time
+ * sent along with the log read command (the time the device was powered off is not accounted for).
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/bluetooth/conn.h>
+#include <bluetooth/services/nus.h>
+
+#include <stddef.h>
+#include <string.h>
+
+#include "nus_cmd.h"
+#include "scheduler.h"
+#include "sensors.h"
+
+typedef struct {
+	// device time in seconds
+	uint32_t timestamp;
+	// temperature in 0.005 degree steps
+	int16_t temperature;
+	// humidity in 0.0025% steps
+	uint16_t humidity;
+} history_record_t;
+
+/**
+ * @brief restore the history state from flash.
+ *
+ * @return 0 on success, negative error code otherwise (history is disabled in that case)
+ */
+int init_history(void);
+
+/**
+ * @brief add the given measurements to the history, if CONFIG_HISTORY_INTERVAL_SEC has passed
+ * since the last record.
+ *
+ * Must be called from the application work queue.
+ */
+void history_log(const measurement_t *measurements);
+
+/**
+ * @brief stream all records newer than start to the given connection.
+ *
+ * Records are sent as Ruuvi log records in batches of the negotiated MTU, followed by the end of
+ * log marker. The transfer runs on the application work queue, one batch per work item, so it is
+ * interleaved with the measurements.
+ *
+ * @param conn connection to send the records to
+ * @param now current unix time of the client
+ * @param start unix time of the oldest record to send
+ *
+ * @return 0 if the transfer was started, -EBUSY if another transfer is running
+ */
+int history_request_read(struct bt_conn *conn, uint32_t now, uint32_t start);
+
+#endif // HISTORY_H
@@ -2,6 +2,8 @@
 
 LOG_MODULE_REGISTER(led_ctrl);
 
+#if LEDS_AVAILABLE
+
 // GPIO LEDs
 static const struct gpio_dt_spec led_1 = GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios);
 
@@ -14,13 +16,28 @@ static const struct pwm_dt_spec blue_pwm_led = PWM_DT_SPEC_GET(DT_ALIAS(blue_pwm
 
 static const struct pwm_dt_spec *pwm_leds[] = {&red_pwm_led, &green_pwm_led, &blue_pwm_led};
 static size_t number_of_pwm_leds = sizeof(pwm_leds) / sizeof(pwm_leds[0]);
-// current pattern and step
-static const led_pattern_t *current_pattern = NULL;
-static int pattern_step = 0;
-// timer object to handle pulsing
-static struct k_timer led_timer;
 // indicator whether leds have been initialized
 static bool leds_initialized = false;
+// LED1 stays on after its pattern, the GPIO port must not be suspended then
+static bool led1_on = false;
+
+// pattern handover, set_led_pattern() stores the pattern and raises the flag, the work item
+// picks it up the next time it runs
+static atomic_ptr_t requested_pattern = ATOMIC_PTR_INIT(NULL);
+static atomic_t pattern_changed = ATOMIC_INIT(0);
+
+// playback state, only accessed from the LED work item
+static const led_pattern_t *current_pattern = NULL;
+static uint8_t frame;
+static uint8_t iteration;
+static uint32_t frame_elapsed_ms;
+static led_color_t fade_from;
+static bool pwm_suspended = false;
+static bool gpio_suspended = false;
+static uint32_t active_start;
+
+static void led_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(led_work, led_work_handler);
 
 // utility function to set RGB values
 void set_rgb(uint32_t r, uint32_t g, uint32_t b)
@@ -30,51 +47,181 @@ void set_rgb(uint32_t r, uint32_t g, uint32_t b)
 	pwm_set_pulse_dt(&blue_pwm_led, b);
 }
 
-// utility functions to turn off the LEDs
+static void set_color(led_color_t color)
+{
+	set_rgb((PWM_PERIOD_USEC * color.r) / 255, (PWM_PERIOD_USEC * color.g) / 255,
+		(PWM_PERIOD_USEC * color.b) / 255);
+}
+
+// utility function to turn off the LEDs, suspended PWM LEDs are off already
 void pwm_off()
 {
-	set_rgb(0, 0, 0);
+	if (!pwm_suspended) {
+		set_rgb(0, 0, 0);
+	}
+}
+
+// suspend or resume a device, with runtime PM the reference counting takes care of devices shared
+// by several LEDs (or other users)
+static int device_set_suspended(const struct device *dev, bool suspend)
+{
+#if defined(CONFIG_PM_DEVICE_RUNTIME)
+	return suspend ? pm_device_runtime_put(dev) : pm_device_runtime_get(dev);
+#elif defined(CONFIG_PM_DEVICE)
+	int err = pm_device_action_run(dev, suspend ? PM_DEVICE_ACTION_SUSPEND
+						    : PM_DEVICE_ACTION_RESUME);
+	// all PWM LEDs may share the same device
+	return err == -EALREADY ? 0 : err;
+#else
+	return 0;
+#endif
+}
+
+static void pwm_devices_set_suspended(bool suspend)
+{
+	for (int i = 0; i < number_of_pwm_leds; i++) {
+		int err = device_set_suspended(pwm_leds[i]->dev, suspend);
+		if (err) {
+			LOG_WRN("PWM led%d could not be %s, err %d", i,
+				suspend ? "suspended" : "resumed", err);
+		}
+	}
+}
+
+// suspend or resume the PWM peripherals
+static void pwm_set_suspended(bool suspend)
+{
+	if (pwm_suspended == suspend) {
+		return;
+	}
+	pwm_devices_set_suspended(suspend);
+	pwm_suspended = suspend;
+
+	// the time between resume and suspend, count x avg is the active time of the PWM
+	if (suspend) {
+		perf_timer_stop(PERF_TIMER_LED_ACTIVE, active_start);
+	} else {
+		active_start = perf_timer_start();
+	}
+}
+
+// suspend or resume the GPIO port of LED1, only handled by runtime PM, as the port may be used by
+// others, they have to hold a runtime PM reference on it (as dht.c and lis2dh12.c do)
+static void gpio_set_suspended(bool suspend)
+{
+	if (!IS_ENABLED(CONFIG_PM_DEVICE_RUNTIME) || gpio_suspended == suspend) {
+		return;
+	}
+	int err = device_set_suspended(led_1.port, suspend);
+	if (err) {
+		LOG_WRN("GPIO led could not be %s, err %d", suspend ? "suspended" : "resumed", err);
+	}
+	gpio_suspended = suspend;
+}
+
+static void set_led1(bool on)
+{
+	gpio_set_suspended(false);
+	gpio_pin_set_dt(&led_1, on);
+	led1_on = on;
+}
+
+// while no pattern is shown, the PWM is suspended, the GPIO port as well unless LED1 is on
+static void update_power_state(void)
+{
+	pwm_set_suspended(!current_pattern);
+	gpio_set_suspended(!current_pattern && !led1_on);
+}
+
+static led_color_t interpolate(led_color_t from, led_color_t to, uint32_t elapsed,
+			       uint32_t duration)
+{
+	led_color_t color = {
+		.r = from.r + ((int32_t)(to.r - from.r) * (int32_t)elapsed) / (int32_t)duration,
+		.g = from.g + ((int32_t)(to.g - from.g) * (int32_t)elapsed) / (int32_t)duration,
+		.b = from.b + ((int32_t)(to.b - from.b) * (int32_t)elapsed) / (int32_t)duration,
+	};
+	return color;
 }
 
-void gpio_off()
+static void start_pattern(const led_pattern_t *pattern)
 {
-	gpio_pin_set_dt(&led_1, false);
+	current_pattern = pattern;
+	frame = 0;
+	iteration = 0;
+	frame_elapsed_ms = 0;
+	fade_from = (led_color_t){0, 0, 0};
+
+	if (pattern) {
+		LOG_DBG("activating LED Pattern %s", pattern->name);
+	} else {
+		LOG_DBG("turning all LEDs off");
+		pwm_off();
+		set_led1(false);
+	}
+	update_power_state();
 }
 
-void all_off()
+static void finish_pattern(void)
 {
+	if (current_pattern->led1 != LED1_UNCHANGED) {
+		set_led1(current_pattern->led1 == LED1_ON);
+	}
+	current_pattern = NULL;
 	pwm_off();
-	gpio_off();
+	update_power_state();
 }
 
-// handle timer events, stops the timer if the pattern has finished
-void led_timer_handler(struct k_timer *timer)
+// plays the current pattern, reschedules itself for the next keyframe (or fade step) until the
+// pattern has finished
+static void led_work_handler(struct k_work *work)
 {
-	if (current_pattern && current_pattern->step_fn) {
-		bool running = current_pattern->step_fn(&pattern_step);
-		if (!running) {
-			k_timer_stop(&led_timer);
+	perf_inc(PERF_LED_WAKEUPS);
+	TRACE_POINT("led", frame, frame_elapsed_ms);
+
+	if (atomic_cas(&pattern_changed, 1, 0)) {
+		start_pattern(atomic_ptr_get(&requested_pattern));
+	}
+	if (!current_pattern) {
+		return;
+	}
+
+	const led_keyframe_t *keyframe = &current_pattern->frames[frame];
+	if (frame_elapsed_ms >= keyframe->duration_ms) {
+		// keyframe is done, continue with the next one
+		fade_from = keyframe->color;
+		frame_elapsed_ms = 0;
+		if (++frame == current_pattern->frame_count) {
+			frame = 0;
+			iteration++;
+			if (current_pattern->repeat && iteration >= current_pattern->repeat) {
+				finish_pattern();
+				return;
+			}
 		}
+		keyframe = &current_pattern->frames[frame];
+	}
+
+	uint32_t delay = keyframe->duration_ms - frame_elapsed_ms;
+	if (keyframe->fade) {
+		delay = MIN(delay, STEP_DURATION_MS);
+		set_color(interpolate(fade_from, keyframe->color, frame_elapsed_ms + delay,
+				      keyframe->duration_ms));
+	} else {
+		set_color(keyframe->color);
 	}
+	frame_elapsed_ms += delay;
+	k_work_schedule(&led_work, K_MSEC(delay));
 }
 
 // sets and triggers the given led pattern
-// todo: can cause a dead lock, if timing is unlucky... add a locking mechanism or cancel timer
-// immediately when invoked?
 void set_led_pattern(const led_pattern_t *pattern)
 {
 	if (leds_initialized) {
-		current_pattern = pattern;
-		pattern_step = 0;
-
-		if (pattern) {
-			LOG_DBG("activating LED Pattern %s", pattern->name);
-			k_timer_start(&led_timer, K_NO_WAIT, STEP_DURATION);
-		} else {
-			LOG_DBG("turning all LEDs off");
-			k_timer_stop(&led_timer);
-			all_off();
-		}
+		atomic_ptr_set(&requested_pattern, (atomic_ptr_val_t)pattern);
+		atomic_set(&pattern_changed, 1);
+		// run right away, cancelling the delay of the current keyframe
+		k_work_reschedule(&led_work, K_NO_WAIT);
 	} else {
 		LOG_WRN("some of the GPIO or PWM LEDs could not be initialized, ignoring...");
 	}
@@ -104,220 +251,129 @@ void init_leds(void)
 	LOG_INF("All %d PWM LEDs are ready", number_of_pwm_leds);
 	leds_initialized = true;
 
-	// initialize the timer to handle PWM pulsing
-	k_timer_init(&led_timer, led_timer_handler, NULL);
+	// nothing to show yet, keep the PWM suspended until the first pattern is set
+	pwm_off();
+#ifdef CONFIG_PM_DEVICE_RUNTIME
+	// enabling runtime PM suspends the devices right away, unless others hold a reference
+	for (int i = 0; i < number_of_pwm_leds; i++) {
+		pm_device_runtime_enable(pwm_leds[i]->dev);
+	}
+	pm_device_runtime_enable(led_1.port);
+	gpio_suspended = true;
+#else
+	// the PWM is active since boot, that time is not part of PERF_TIMER_LED_ACTIVE
+	pwm_devices_set_suspended(true);
+#endif
+	pwm_suspended = true;
 }
 
-// error pattern for BLE init failure
-bool pattern_ble_init_failed_step(int *step)
+#else
+
+void set_led_pattern(const led_pattern_t *pattern)
 {
-	switch (*step) {
-	case 0:
-		set_rgb(PWM_PERIOD_USEC, 0, 0);
-		break;
-	case 40:
-		pwm_off();
-		break;
-	case 140:
-		*step = -1;
-		break;
-	}
-	(*step)++;
-	return true;
+	ARG_UNUSED(pattern);
 }
 
-const led_pattern_t PATTERN_BLE_INIT_FAILED = {
-	.name = "BLE Init Failed",
-	.step_fn = pattern_ble_init_failed_step,
-};
-
-// error pattern for ble advertising failure
-bool pattern_ble_advertising_failed_step(int *step)
+void init_leds(void)
 {
-	switch (*step) {
-	case 0:
-	case 8:
-		set_rgb(PWM_PERIOD_USEC, 0, 0); // red blink
-		break;
-	case 4:
-	case 12:
-		pwm_off();
-		break;
-	case 40:
-		*step = -1; // reset after pause
-		break;
-	}
-	(*step)++;
-	return true;
+	LOG_INF("no LEDs available, patterns are not shown");
 }
 
-const led_pattern_t PATTERN_BLE_ADVERTISING_FAILED = {
-	.name = "BLE Advertising Failed",
-	.step_fn = pattern_ble_advertising_failed_step,
-};
+#endif // LEDS_AVAILABLE
 
-// pattern for collecting sensor data
-bool pattern_collecting_sensor_step(int *step)
-{
-	if (*step % 2 == 1) {
-		set_rgb(PWM_PERIOD_USEC, PWM_PERIOD_USEC, 0); // yellow on
-	} else {
-		pwm_off();
+#define LED_OFF    {0, 0, 0}
+#define LED_RED    {255, 0, 0}
+#define LED_YELLOW {255, 255, 0}
+#define LED_CYAN   {0, 255, 128}
+#define LED_BLUE   {0, 0, 255}
+#define LED_PINK   {255, 64, 128}
+#define LED_PURPLE {255, 0, 255}
+
+#define LED_PATTERN(_name, _frames, _repeat, _led1)                                                \
+	{                                                                                          \
+		.name = _name, .frames = _frames, .frame_count = ARRAY_SIZE(_frames),              \
+		.repeat = _repeat, .led1 = _led1,                                                  \
 	}
-	(*step)++;
-	return true;
-}
 
-const led_pattern_t PATTERN_COLLECTING_SENSOR = {
-	.name = "Collecting Sensor Measurements",
-	.step_fn = pattern_collecting_sensor_step,
+// error pattern for BLE init failure
+static const led_keyframe_t ble_init_failed_frames[] = {
+	{LED_RED, 2000, false},
+	{LED_OFF, 3000, false},
 };
 
-// pattern for advertising data change
-bool pattern_ble_advertising_step(int *step)
-{
-	int phase = *step % 40;
-	uint32_t duty;
-	// calculate duty cycle for breathing pattern
-	if (phase < 20) {
-		duty = (PWM_PERIOD_USEC * phase) / 20;
-	} else {
-		duty = (PWM_PERIOD_USEC * (40 - phase)) / 20;
-	}
+const led_pattern_t PATTERN_BLE_INIT_FAILED =
+	LED_PATTERN("BLE Init Failed", ble_init_failed_frames, 0, LED1_UNCHANGED);
 
-	set_rgb(0, duty, duty / 2);
-	if (*step == 80) {
-		pwm_off();
-		return false;
-	}
-	(*step)++;
-	return true;
-}
+// error pattern for ble advertising failure
+static const led_keyframe_t ble_advertising_failed_frames[] = {
+	{LED_RED, 200, false},
+	{LED_OFF, 200, false},
+	{LED_RED, 200, false},
+	{LED_OFF, 1450, false},
+};
+
+const led_pattern_t PATTERN_BLE_ADVERTISING_FAILED = LED_PATTERN(
+	"BLE Advertising Failed", ble_advertising_failed_frames, 0, LED1_UNCHANGED);
 
-const led_pattern_t PATTERN_BLE_ADVERTISING = {
-	.name = "BLE Advertising Updated",
-	.step_fn = pattern_ble_advertising_step,
+// pattern for collecting sensor data
+static const led_keyframe_t collecting_sensor_frames[] = {
+	{LED_YELLOW, 50, false},
+	{LED_OFF, 50, false},
 };
 
-// pattern for successful ble connection
-bool pattern_ble_connected_step(int *step)
-{
-	switch (*step) {
-	case 0:
-	case 2:
-	case 4:
-	case 6:
-		set_rgb(0, 0, PWM_PERIOD_USEC);
-		break;
-	case 7:
-		pwm_off();
-		gpio_pin_toggle_dt(&led_1);
-		return false;
-	default:
-		pwm_off();
-	}
-	(*step)++;
-	return true;
-}
+const led_pattern_t PATTERN_COLLECTING_SENSOR = LED_PATTERN(
+	"Collecting Sensor Measurements", collecting_sensor_frames, 3, LED1_UNCHANGED);
 
-const led_pattern_t PATTERN_BLE_CONNECTED = {
-	.name = "BLE Connected",
-	.step_fn = pattern_ble_connected_step,
+// pattern for advertising data change
+static const led_keyframe_t ble_advertising_frames[] = {
+	{LED_CYAN, 1000, true},
+	{LED_OFF, 1000, true},
 };
 
-// pattern for ble connection failure
-static bool pattern_ble_connection_failed_step(int *step)
-{
-	switch (*step) {
-	case 0:
-	case 8:
-	case 16:
-		set_rgb(PWM_PERIOD_USEC, 0, 0);
-		break;
-	case 4:
-	case 12:
-	case 20:
-		all_off();
-		return false;
-	}
-	(*step)++;
-	return true;
-}
+const led_pattern_t PATTERN_BLE_ADVERTISING =
+	LED_PATTERN("BLE Advertising Updated", ble_advertising_frames, 2, LED1_UNCHANGED);
 
-const led_pattern_t PATTERN_BLE_CONNECTION_FAILED = {
-	.name = "BLE Connection Failed",
-	.step_fn = pattern_ble_connection_failed_step,
+// pattern for successful ble connection
+static const led_keyframe_t ble_connected_frames[] = {
+	{LED_BLUE, 50, false},
+	{LED_OFF, 50, false},
 };
 
-// pattern for ble disconnection
-bool pattern_ble_disconnected_step(int *step)
-{
-	switch (*step) {
-	case 0:
-		set_rgb(0, 0, PWM_PERIOD_USEC);
-		break;
-	case 2:
-		set_rgb(PWM_PERIOD_USEC, 0, 0);
-		break;
-	case 4:
-		all_off();
-		return false;
-	}
-	(*step)++;
-	return true;
-}
+const led_pattern_t PATTERN_BLE_CONNECTED =
+	LED_PATTERN("BLE Connected", ble_connected_frames, 4, LED1_ON);
 
-const led_pattern_t PATTERN_BLE_DISCONNECTED = {
-	.name = "BLE Disconnected",
-	.step_fn = pattern_ble_disconnected_step,
+// pattern for ble connection failure
+static const led_keyframe_t ble_connection_failed_frames[] = {
+	{LED_RED, 200, false},
+	{LED_OFF, 200, false},
 };
 
-// pattern for DIS TX received
-bool pattern_dis_tx_received_step(int *step)
-{
+const led_pattern_t PATTERN_BLE_CONNECTION_FAILED = LED_PATTERN(
+	"BLE Connection Failed", ble_connection_failed_frames, 3, LED1_UNCHANGED);
 
-	switch (*step) {
-	case 0:
-	case 2:
-		set_rgb(PWM_PERIOD_USEC, PWM_PERIOD_USEC / 4, PWM_PERIOD_USEC / 2);
-		break;
-	case 3:
-		pwm_off();
-		return false;
-	default:
-		pwm_off();
-	}
-	(*step)++;
-	return true;
-}
+// pattern for ble disconnection
+static const led_keyframe_t ble_disconnected_frames[] = {
+	{LED_BLUE, 100, false},
+	{LED_RED, 100, false},
+};
+
+const led_pattern_t PATTERN_BLE_DISCONNECTED =
+	LED_PATTERN("BLE Disconnected", ble_disconnected_frames, 1, LED1_OFF);
 
-const led_pattern_t PATTERN_DIS_TX_RECEIVED = {
-	.name = "DIS TX Command Received",
-	.step_fn = pattern_dis_tx_received_step,
+// pattern for DIS TX received
+static const led_keyframe_t dis_tx_received_frames[] = {
+	{LED_PINK, 50, false},
+	{LED_OFF, 50, false},
 };
 
-// pattern for NUS RX received
-bool pattern_nus_rx_received_step(int *step)
-{
+const led_pattern_t PATTERN_DIS_TX_RECEIVED =
+	LED_PATTERN("DIS TX Command Received", dis_tx_received_frames, 2, LED1_UNCHANGED);
 
-	switch (*step) {
-	case 0:
-	case 2:
-	case 4:
-	case 6:
-		set_rgb(PWM_PERIOD_USEC, 0, PWM_PERIOD_USEC);
-		break;
-	case 7:
-		pwm_off();
-		return false;
-	default:
-		pwm_off();
-	}
-	(*step)++;
-	return true;
-}
+// pattern for NUS RX received
+static const led_keyframe_t nus_rx_received_frames[] = {
+	{LED_PURPLE, 50, false},
+	{LED_OFF, 50, false},
+};
 
-const led_pattern_t PATTERN_NUS_RX_RECEIVED = {
-	.name = "NUS RX Command Received",
-	.step_fn = pattern_nus_rx_received_step,
-};
\ No newline at end of file
+const led_pattern_t PATTERN_NUS_RX_RECEIVED =
+	LED_PATTERN("NUS RX Command Received", nus_rx_received_frames, 4, LED1_UNCHANGED);
@@ -8,17 +8,22 @@
  * | ------------------------------ | --------- | --------------------------------- | -------------	|
  * | PATTERN_BLE_INIT_FAILED        | Red       | Solid 2s every 5s                 | Forever   	|
  * | PATTERN_BLE_ADVERTISING_FAILED | Red       | Two quick flashes, then pause     | Forever   	|
- * | PATTERN_COLLECTING_SENSOR      | Yellow    | Pulsing                           | 100ms/cycle	|
+ * | PATTERN_COLLECTING_SENSOR      | Yellow    | Three short pulses                | 300ms		|
  * | PATTERN_BLE_ADVERTISING        | Cyan      | Smooth fade in/out                | 4000ms		|
- * | PATTERN_BLE_CONNECTED          | Red-Blue  | Blue to blue flash transition     | 400ms     	|
- * | PATTERN_BLE_CONNECTION_FAILED  | Red       | Three quick flashes               | 1000ms   		|
- * | PATTERN_BLE_DISCONNECTED       | Blue-Red	| Red to blue flash transition     	| 200ms     	|
+ * | PATTERN_BLE_CONNECTED          | Blue      | Four quick flashes                | 400ms     	|
+ * | PATTERN_BLE_CONNECTION_FAILED  | Red       | Three quick flashes               | 1200ms   		|
+ * | PATTERN_BLE_DISCONNECTED       | Blue-Red	| Blue to red flash transition     	| 200ms     	|
  * | PATTERN_DIS_TX_RECEIVED	    | Pink 		| Pulsing					     	| 200ms     	|
  * | PATTERN_NUS_RX_RECEIVED        | Purple    | Pulsing		                    | 400ms     	|
  *
  * NOTE: PATTERN_BLE_CONNECTED will also turn on LED1, the PATTERN_BLE_DISCONNECTED will
  * turn it off again.
  *
+ * Patterns are tables of keyframes, which are played by a single delayable work item. It only
+ * wakes up once per keyframe (every STEP_DURATION while fading), and once no pattern is active,
+ * nothing is scheduled anymore and the PWM peripheral is suspended. With CONFIG_PM_DEVICE_RUNTIME,
+ * the PWM and GPIO devices are suspended through runtime PM, the GPIO port only while LED1 is off.
+ * Every other user of that port has to hold a runtime PM reference on it (pm_device_runtime_get()).
  */
 
 #ifndef LED_H
@@ -31,24 +36,53 @@ extern "C" {
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/pm/device_runtime.h>
 #include <zephyr/drivers/pwm.h>
 #include <zephyr/drivers/gpio.h>
 
 #include <stdbool.h>
 
-#define PWM_PERIOD_USEC PWM_USEC(2000)
-#define STEP_DURATION   K_MSEC(50)
+#include "perf.h"
+#include "trace.h"
 
-/**
- * @brief PWM step function to control PWM LED patterns
- *
- * @return false, if the pattern has completed
- */
-typedef bool (*led_pattern_fn_t)(int *step);
+// the LEDs are optional, e.g. simulated boards (nrf52_bsim) do not provide them
+#define LEDS_AVAILABLE                                                                             \
+	(DT_NODE_EXISTS(DT_ALIAS(led0)) && DT_NODE_EXISTS(DT_ALIAS(red_pwm_led)) &&                \
+	 DT_NODE_EXISTS(DT_ALIAS(green_pwm_led)) && DT_NODE_EXISTS(DT_ALIAS(blue_pwm_led)))
+
+#define PWM_PERIOD_USEC  PWM_USEC(2000)
+#define STEP_DURATION_MS 50
+#define STEP_DURATION    K_MSEC(STEP_DURATION_MS)
+
+typedef struct {
+	// brightness of the red, green and blue channel (0 ... 255)
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+} led_color_t;
+
+typedef struct {
+	led_color_t color;
+	uint16_t duration_ms;
+	// fade linearly from the color of the previous keyframe (off for the first one)
+	bool fade;
+} led_keyframe_t;
+
+typedef enum {
+	LED1_UNCHANGED,
+	LED1_ON,
+	LED1_OFF,
+} led1_action_t;
 
 typedef struct {
 	const char *name;
-	led_pattern_fn_t step_fn;
+	const led_keyframe_t *frames;
+	uint8_t frame_count;
+	// number of times the keyframes are played, 0 repeats the pattern forever
+	uint8_t repeat;
+	// applied to LED1 once the pattern has finished
+	led1_action_t led1;
 } led_pattern_t;
 
 extern const led_pattern_t PATTERN_BLE_INIT_FAILED;
@@ -63,6 +97,8 @@ extern const led_pattern_t PATTERN_NUS_RX_RECEIVED;
 
 /**
  * @brief init the LEDs. Must be invoked in order to show any patterns
+ *
+ * Without LEDs (LEDS_AVAILABLE), all patterns are ignored.
  */
 void init_leds(void);
 
@@ -71,9 +107,8 @@ void init_leds(void);
  *
  * In order to reset the current pattern or turn the LEDs off, invoke with NULL.
  *
- * NOTE: setting a pattern while another one is already running will override it.
- * It also might sometimes cause deadlocks... its really up to chance
- *
+ * Can be called from any context, including ISRs. The pattern is handed over to the LED work
+ * item without locking, setting a pattern while another one is running overrides it.
  */
 void set_led_pattern(const led_pattern_t *pattern);
 
@@ -81,4 +116,4 @@ void set_led_pattern(const led_pattern_t *pattern);
 }
 #endif
 
-#endif // LED_H
\ No newline at end of file
+#endif // LED_H
@@ -0,0 +1,258 @@
+#include "lis2dh12.h"
+
+LOG_MODULE_REGISTER(lis2dh12);
+
+#define REG_WHO_AM_I      0x0F
+#define REG_CTRL_REG1     0x20
+#define REG_CTRL_REG2     0x21
+#define REG_CTRL_REG3     0x22
+#define REG_CTRL_REG4     0x23
+#define REG_CTRL_REG5     0x24
+#define REG_CTRL_REG6     0x25
+#define REG_REFERENCE     0x26
+#define REG_OUT_X_L       0x28
+#define REG_FIFO_CTRL_REG 0x2E
+#define REG_FIFO_SRC_REG  0x2F
+#define REG_INT1_CFG      0x30
+#define REG_INT1_THS      0x32
+#define REG_INT1_DURATION 0x33
+// MSB of the register address: auto increment on multi byte reads
+#define REG_AUTO_INCREMENT 0x80
+
+#define WHO_AM_I_VALUE       0x33
+// CTRL_REG1: ODR, low power mode, X, Y and Z enabled
+#define CTRL_REG1_LPEN       BIT(3)
+#define CTRL_REG1_XYZ_EN     0x07
+// CTRL_REG2: high-pass filter on interrupt generator 1 only, the FIFO gets unfiltered samples
+#define CTRL_REG2_HP_IA1     BIT(0)
+// CTRL_REG3: FIFO watermark on INT1
+#define CTRL_REG3_I1_WTM     BIT(2)
+// CTRL_REG4: block data update, +-2g
+#define CTRL_REG4_BDU        BIT(7)
+#define CTRL_REG5_FIFO_EN    BIT(6)
+#define CTRL_REG5_BOOT       BIT(7)
+// CTRL_REG6: interrupt generator 1 on INT2
+#define CTRL_REG6_I2_IA1     BIT(6)
+#define FIFO_CTRL_STREAM     (2 << 6)
+#define FIFO_SRC_OVRN        BIT(6)
+#define FIFO_SRC_FSS_MASK    0x1F
+// INT1_CFG: OR of the high events of all axes
+#define INT1_CFG_XYZ_HIGH    0x2A
+#define FIFO_SIZE            32
+#define SAMPLE_LEN           6
+// low power mode, +-2g: 8bit left aligned samples, 16mG per digit
+#define MG_PER_DIGIT         16
+#define BOOT_TIME_MS         5
+
+BUILD_ASSERT(CONFIG_ACCEL_FIFO_WATERMARK < FIFO_SIZE, "watermark must be below the FIFO size");
+BUILD_ASSERT(CONFIG_ACCEL_ODR_HZ == 1 || CONFIG_ACCEL_ODR_HZ == 10 || CONFIG_ACCEL_ODR_HZ == 25 ||
+		     CONFIG_ACCEL_ODR_HZ == 50 || CONFIG_ACCEL_ODR_HZ == 100,
+	     "unsupported sample rate");
+
+static const struct i2c_dt_spec i2c = I2C_DT_SPEC_GET(LIS2DH12_NODE);
+static const struct gpio_dt_spec int1 = GPIO_DT_SPEC_GET(LIS2DH12_NODE, int1_gpios);
+#if LIS2DH12_HAS_MOTION
+static const struct gpio_dt_spec int2 = GPIO_DT_SPEC_GET(LIS2DH12_NODE, int2_gpios);
+static struct gpio_callback int2_cb;
+#endif
+static struct gpio_callback int1_cb;
+
+// written by the INT2 ISR
+static atomic_t movements = ATOMIC_INIT(0);
+
+// sums since the last take, only accessed from the application work queue
+static int32_t sums[3];
+static uint32_t sample_count;
+static uint8_t fifo[FIFO_SIZE * SAMPLE_LEN];
+
+static void fifo_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(fifo_work, fifo_work_handler);
+
+// CTRL_REG1 ODR bits of the supported rates
+static uint8_t odr_bits(void)
+{
+	switch (CONFIG_ACCEL_ODR_HZ) {
+	case 1:
+		return 1;
+	case 10:
+		return 2;
+	case 25:
+		return 3;
+	case 50:
+		return 4;
+	default:
+		return 5;
+	}
+}
+
+static int write_reg(uint8_t reg, uint8_t value)
+{
+	return i2c_reg_write_byte_dt(&i2c, reg, value);
+}
+
+static void fifo_work_handler(struct k_work *work)
+{
+	uint8_t src;
+	uint32_t start = perf_timer_start();
+
+	int err = i2c_reg_read_byte_dt(&i2c, REG_FIFO_SRC_REG, &src);
+	if (err) {
+		LOG_WRN("FIFO status could not be read, err %d", err);
+		return;
+	}
+	if (src & FIFO_SRC_OVRN) {
+		LOG_DBG("FIFO overrun, samples lost");
+	}
+	size_t count = src & FIFO_SRC_FSS_MASK;
+	if (count == 0) {
+		return;
+	}
+	// the read address rolls back from OUT_Z_H to OUT_X_L, the FIFO is read in a single burst
+	err = i2c_burst_read_dt(&i2c, REG_OUT_X_L | REG_AUTO_INCREMENT, fifo, count * SAMPLE_LEN);
+	if (err) {
+		LOG_WRN("FIFO could not be read, err %d", err);
+		return;
+	}
+	for (size_t i = 0; i < count; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			// the high byte holds the 8bit sample
+			sums[axis] += (int8_t)fifo[i * SAMPLE_LEN + 2 * axis + 1] * MG_PER_DIGIT;
+		}
+	}
+	sample_count += count;
+	perf_timer_stop(PERF_TIMER_ACCEL_FIFO, start);
+}
+
+// FIFO watermark reached
+static void int1_handler(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	k_work_submit_to_queue(&app_work_q, &fifo_work);
+}
+
+#if LIS2DH12_HAS_MOTION
+// motion detected, counting does not need to wake up a thread
+static void int2_handler(const struct device *port, struct gpio_callback *cb, uint32_t pins)
+{
+	atomic_inc(&movements);
+}
+#endif
+
+static int setup_interrupt(const struct gpio_dt_spec *spec, struct gpio_callback *cb,
+			   gpio_callback_handler_t handler)
+{
+	if (!gpio_is_ready_dt(spec)) {
+		return -ENODEV;
+	}
+#ifdef CONFIG_PM_DEVICE_RUNTIME
+	// the interrupts must fire while the LED module suspends its GPIO port (led.h), hold a
+	// reference in case the port is shared
+	int err = pm_device_runtime_enable(spec->port);
+	if (!err) {
+		err = pm_device_runtime_get(spec->port);
+	}
+	if (err) {
+		return err;
+	}
+#else
+	int err;
+#endif
+	err = gpio_pin_configure_dt(spec, GPIO_INPUT);
+	if (err) {
+		return err;
+	}
+	gpio_init_callback(cb, handler, BIT(spec->pin));
+	err = gpio_add_callback_dt(spec, cb);
+	if (err) {
+		return err;
+	}
+	return gpio_pin_interrupt_configure_dt(spec, GPIO_INT_EDGE_TO_ACTIVE);
+}
+
+static int configure(void)
+{
+	uint8_t reference;
+	int err;
+
+	// reboot the memory content, so a warm restart starts from the default configuration
+	err = write_reg(REG_CTRL_REG5, CTRL_REG5_BOOT);
+	if (err) {
+		return err;
+	}
+	k_msleep(BOOT_TIME_MS);
+
+	const uint8_t config[][2] = {
+		{REG_CTRL_REG2, CTRL_REG2_HP_IA1},
+		{REG_CTRL_REG3, CTRL_REG3_I1_WTM},
+		{REG_CTRL_REG4, CTRL_REG4_BDU},
+		{REG_CTRL_REG5, CTRL_REG5_FIFO_EN},
+		{REG_CTRL_REG6, LIS2DH12_HAS_MOTION ? CTRL_REG6_I2_IA1 : 0},
+		{REG_FIFO_CTRL_REG, FIFO_CTRL_STREAM | CONFIG_ACCEL_FIFO_WATERMARK},
+		{REG_INT1_THS, CONFIG_ACCEL_MOTION_THRESHOLD_MG / MG_PER_DIGIT},
+		{REG_INT1_DURATION, 0},
+		{REG_INT1_CFG, LIS2DH12_HAS_MOTION ? INT1_CFG_XYZ_HIGH : 0},
+		// start sampling last
+		{REG_CTRL_REG1, (odr_bits() << 4) | CTRL_REG1_LPEN | CTRL_REG1_XYZ_EN},
+	};
+	for (int i = 0; i < ARRAY_SIZE(config); i++) {
+		err = write_reg(config[i][0], config[i][1]);
+		if (err) {
+			return err;
+		}
+	}
+	// reading the reference resets the high-pass filter to the current acceleration
+	return i2c_reg_read_byte_dt(&i2c, REG_REFERENCE, &reference);
+}
+
+int lis2dh12_init(void)
+{
+	uint8_t id;
+
+	if (!i2c_is_ready_dt(&i2c)) {
+		return -ENODEV;
+	}
+	int err = i2c_reg_read_byte_dt(&i2c, REG_WHO_AM_I, &id);
+	if (err) {
+		return err;
+	}
+	if (id != WHO_AM_I_VALUE) {
+		LOG_ERR("unexpected device id 0x%02x", id);
+		return -ENODEV;
+	}
+
+	err = setup_interrupt(&int1, &int1_cb, int1_handler);
+#if LIS2DH12_HAS_MOTION
+	if (!err) {
+		err = setup_interrupt(&int2, &int2_cb, int2_handler);
+	}
+#endif
+	if (err) {
+		LOG_ERR("interrupts could not be set up, err %d", err);
+		return err;
+	}
+	err = configure();
+	if (err) {
+		LOG_ERR("accelerometer could not be configured, err %d", err);
+		return err;
+	}
+	LOG_INF("sampling at %dHz, %d samples per FIFO read", CONFIG_ACCEL_ODR_HZ,
+		CONFIG_ACCEL_FIFO_WATERMARK);
+	return 0;
+}
+
+int lis2dh12_take(int16_t acceleration[3], uint32_t *movement_count)
+{
+	// the samples below the watermark are collected as well. This also recovers from a missed
+	// watermark edge, which would otherwise stop the FIFO reads.
+	fifo_work_handler(&fifo_work);
+	*movement_count = atomic_get(&movements);
+	if (sample_count == 0) {
+		return -ENODATA;
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		acceleration[axis] = sums[axis] / (int32_t)sample_count;
+		sums[axis] = 0;
+	}
+	sample_count = 0;
+	return 0;
+}
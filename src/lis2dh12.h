@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief Interrupt driven LIS2DH12 accelerometer driver.
+ *
+ * The accelerometer samples in low power mode (8bit, +-2g) at CONFIG_ACCEL_ODR_HZ into its 32
+ * sample FIFO (stream mode). INT1 signals the FIFO watermark (CONFIG_ACCEL_FIFO_WATERMARK
+ * samples), the FIFO is then read in a single burst on the application work queue and summed up
+ * per axis. INT2 signals motion: interrupt generator 1 compares the high-pass filtered samples with
+ * CONFIG_ACCEL_MOTION_THRESHOLD_MG, the ISR only increments the movement counter. In between, the
+ * CPU is never woken up by the accelerometer.
+ */
+
+#ifndef LIS2DH12_H
+#define LIS2DH12_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/sys/atomic.h>
+
+#include <autoconf.h>
+
+#include "perf.h"
+#include "scheduler.h"
+
+#define LIS2DH12_NODE       DT_COMPAT_GET_ANY_STATUS_OKAY(muuvi_lis2dh12)
+// movements are only counted, if INT2 is connected
+#define LIS2DH12_HAS_MOTION DT_NODE_HAS_PROP(LIS2DH12_NODE, int2_gpios)
+
+/**
+ * @brief check the accelerometer, configure it and start sampling.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int lis2dh12_init(void);
+
+/**
+ * @brief average acceleration since the previous call and the movement counter.
+ *
+ * Reads the samples still in the FIFO first. Must only be called from the application work queue.
+ *
+ * @param acceleration average acceleration of the X, Y and Z axis in mG
+ * @param movement_count number of motion interrupts since init, see LIS2DH12_HAS_MOTION
+ *
+ * @return 0 on success, -ENODATA if no samples have been collected since the previous call (the
+ * movement counter is valid nonetheless)
+ */
+int lis2dh12_take(int16_t acceleration[3], uint32_t *movement_count);
+
+#endif // LIS2DH12_H
@@ -1,7 +1,13 @@
 #include <zephyr/logging/log.h>
 
+#include "battery.h"
 #include "ble.h"
+#include "gateway.h"
+#include "history.h"
 #include "led.h"
+#include "params.h"
+#include "scheduler.h"
+#include "sensors.h"
 
 LOG_MODULE_REGISTER(main);
 
@@ -11,7 +17,33 @@ int main(void)
 
 	init_leds();
 
-	init_ble();
+	// before everything using them
+	if (IS_ENABLED(CONFIG_RUNTIME_PARAMS)) {
+		init_params();
+	}
+
+	if (IS_ENABLED(CONFIG_ROLE_SENSOR)) {
+		init_sensors();
+	}
+
+	if (IS_ENABLED(CONFIG_BATTERY_VOLTAGE)) {
+		init_battery();
+	}
+
+	if (IS_ENABLED(CONFIG_HISTORY)) {
+		init_history();
+	}
+
+	if (init_ble()) {
+		return 0;
+	}
+
+	// everything from here on is driven by the scheduler, main can return
+	init_scheduler();
+
+	if (IS_ENABLED(CONFIG_ROLE_GATEWAY)) {
+		init_gateway();
+	}
 
 	return 0;
 }
@@ -0,0 +1,319 @@
+#include "nus_cmd.h"
+
+LOG_MODULE_REGISTER(nus_cmd);
+
+// largest possible NUS payload
+#define NUS_TX_BUF_LEN        (CONFIG_BT_L2CAP_TX_MTU - 3)
+#define NUS_REQUEST_QUEUE_LEN 8
+
+typedef int (*nus_cmd_handler_t)(struct bt_conn *conn, const uint8_t *msg);
+
+typedef struct {
+	uint8_t destination;
+	uint8_t op;
+	nus_cmd_handler_t handler;
+} nus_cmd_t;
+
+// command deferred to the application work queue, holds a reference to the connection
+typedef struct {
+	struct bt_conn *conn;
+	uint8_t destination;
+	uint8_t op;
+	uint32_t arg;
+} nus_request_t;
+
+// one pending TX buffer per connection
+NET_BUF_POOL_DEFINE(nus_tx_pool, CONFIG_BT_MAX_CONN, NUS_TX_BUF_LEN, 0, NULL);
+
+// pending TX buffers, indexed by bt_conn_index(), only accessed from the application work queue
+static struct {
+	struct bt_conn *conn;
+	struct net_buf *buf;
+} pending[CONFIG_BT_MAX_CONN];
+
+// connections with the heartbeat enabled, indexed by bt_conn_index()
+static atomic_t heartbeat_conns = ATOMIC_INIT(0);
+
+K_MSGQ_DEFINE(request_q, sizeof(nus_request_t), NUS_REQUEST_QUEUE_LEN, 4);
+
+static void request_work_handler(struct k_work *work);
+static void cleanup_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(request_work, request_work_handler);
+static K_WORK_DEFINE(cleanup_work, cleanup_work_handler);
+
+static void tx_release(uint8_t index)
+{
+	net_buf_unref(pending[index].buf);
+	bt_conn_unref(pending[index].conn);
+	pending[index].buf = NULL;
+	pending[index].conn = NULL;
+}
+
+int nus_flush(struct bt_conn *conn)
+{
+	uint8_t index = bt_conn_index(conn);
+
+	if (!pending[index].buf || pending[index].conn != conn) {
+		return 0;
+	}
+	int err = bt_nus_send(conn, pending[index].buf->data, pending[index].buf->len);
+	tx_release(index);
+	return err;
+}
+
+int nus_send(struct bt_conn *conn, const uint8_t *msg, size_t len)
+{
+	uint8_t index = bt_conn_index(conn);
+	size_t mtu = MIN(bt_nus_get_mtu(conn), NUS_TX_BUF_LEN);
+	int sent = 0;
+
+	if (len > mtu) {
+		return -EMSGSIZE;
+	}
+	if (pending[index].buf && pending[index].conn != conn) {
+		// left over from a previous connection
+		tx_release(index);
+	}
+	if (pending[index].buf && pending[index].buf->len + len > mtu) {
+		int err = nus_flush(conn);
+		if (err) {
+			return err;
+		}
+		sent = 1;
+	}
+	if (!pending[index].buf) {
+		pending[index].buf = net_buf_alloc(&nus_tx_pool, K_NO_WAIT);
+		if (!pending[index].buf) {
+			return -ENOMEM;
+		}
+		pending[index].conn = bt_conn_ref(conn);
+	}
+	net_buf_add_mem(pending[index].buf, msg, len);
+	return sent;
+}
+
+static void heartbeat_cb(struct bt_conn *conn, void *user_data)
+{
+	const struct net_buf_simple *payload = user_data;
+
+	if (!atomic_test_bit(&heartbeat_conns, bt_conn_index(conn))) {
+		return;
+	}
+	// the heartbeat is always sent as a packet of its own
+	int err = nus_flush(conn);
+	if (!err) {
+		err = bt_nus_send(conn, payload->data, payload->len);
+	}
+	if (err) {
+		LOG_WRN("heartbeat could not be sent, err %d", err);
+	}
+}
+
+void nus_heartbeat(const uint8_t *payload, size_t len)
+{
+	struct net_buf_simple buf;
+
+	if (!atomic_get(&heartbeat_conns)) {
+		return;
+	}
+	net_buf_simple_init_with_data(&buf, (void *)payload, len);
+	bt_conn_foreach(BT_CONN_TYPE_LE, heartbeat_cb, &buf);
+}
+
+static int reply_value(const nus_request_t *request)
+{
+	measurement_t measurements;
+	uint8_t msg[RUUVI_MSG_LEN];
+	int err = get_latest_measurements(&measurements);
+
+	if (err) {
+		return err;
+	}
+	// same layout and units as the log records, the timestamp is the one of the request
+	if (request->destination != RUUVI_ENDPOINT_HUMIDITY) {
+		nus_msg_put(msg, RUUVI_ENDPOINT_ENVIRONMENTAL, RUUVI_ENDPOINT_TEMPERATURE,
+			    RUUVI_OP_LOG_VALUE_WRITE, request->arg, measurements.temperature / 2);
+		err = nus_send(request->conn, msg, sizeof(msg));
+	}
+	if (err >= 0 && request->destination != RUUVI_ENDPOINT_TEMPERATURE) {
+		nus_msg_put(msg, RUUVI_ENDPOINT_ENVIRONMENTAL, RUUVI_ENDPOINT_HUMIDITY,
+			    RUUVI_OP_LOG_VALUE_WRITE, request->arg, measurements.humidity / 4);
+		err = nus_send(request->conn, msg, sizeof(msg));
+	}
+	return err;
+}
+
+static int reply_heartbeat(const nus_request_t *request)
+{
+	uint8_t msg[RUUVI_MSG_LEN] = {0};
+
+	msg[RUUVI_MSG_DESTINATION] = RUUVI_ENDPOINT_ENVIRONMENTAL;
+	msg[RUUVI_MSG_SOURCE] = RUUVI_ENDPOINT_ENVIRONMENTAL;
+	msg[RUUVI_MSG_OPERATION] = RUUVI_OP_HEARTBEAT;
+	msg[RUUVI_MSG_PAYLOAD] = request->arg;
+	return nus_send(request->conn, msg, sizeof(msg));
+}
+
+// handles all queued requests, the replies of a request are sent before the next one is handled
+static void request_work_handler(struct k_work *work)
+{
+	nus_request_t request;
+
+	while (k_msgq_get(&request_q, &request, K_NO_WAIT) == 0) {
+		int err = request.op == RUUVI_OP_VALUE_READ ? reply_value(&request)
+							    : reply_heartbeat(&request);
+		if (err >= 0) {
+			err = nus_flush(request.conn);
+		}
+		if (err < 0) {
+			LOG_WRN("reply to command %02X %02X failed, err %d", request.destination,
+				request.op, err);
+		}
+		bt_conn_unref(request.conn);
+	}
+}
+
+// releases the TX buffers of disconnected connections
+static void cleanup_work_handler(struct k_work *work)
+{
+	for (int i = 0; i < ARRAY_SIZE(pending); i++) {
+		struct bt_conn_info info;
+		if (pending[i].conn && (bt_conn_get_info(pending[i].conn, &info) ||
+					info.state != BT_CONN_STATE_CONNECTED)) {
+			tx_release(i);
+		}
+	}
+}
+
+static int defer_request(struct bt_conn *conn, const uint8_t *msg, uint32_t arg)
+{
+	nus_request_t request = {
+		.conn = bt_conn_ref(conn),
+		.destination = msg[RUUVI_MSG_DESTINATION],
+		.op = msg[RUUVI_MSG_OPERATION],
+		.arg = arg,
+	};
+
+	if (k_msgq_put(&request_q, &request, K_NO_WAIT)) {
+		bt_conn_unref(conn);
+		return -EBUSY;
+	}
+	k_work_submit_to_queue(&app_work_q, &request_work);
+	return 0;
+}
+
+// with encrypted advertisements, the measurements are only sent in clear over an encrypted link
+static bool plaintext_allowed(struct bt_conn *conn)
+{
+	return !IS_ENABLED(CONFIG_ADV_ENCRYPTION) || bt_conn_get_security(conn) >= BT_SECURITY_L2;
+}
+
+static int cmd_log_read(struct bt_conn *conn, const uint8_t *msg)
+{
+	if (!IS_ENABLED(CONFIG_HISTORY)) {
+		return -ENOTSUP;
+	}
+	if (!plaintext_allowed(conn)) {
+		return -EACCES;
+	}
+	// current time and start time of the log
+	return history_request_read(conn, sys_get_be32(&msg[RUUVI_MSG_PAYLOAD]),
+				    sys_get_be32(&msg[RUUVI_MSG_PAYLOAD + 4]));
+}
+
+static int cmd_value_read(struct bt_conn *conn, const uint8_t *msg)
+{
+	if (!plaintext_allowed(conn)) {
+		return -EACCES;
+	}
+	return defer_request(conn, msg, sys_get_be32(&msg[RUUVI_MSG_PAYLOAD]));
+}
+
+static int cmd_heartbeat(struct bt_conn *conn, const uint8_t *msg)
+{
+	bool enable = msg[RUUVI_MSG_PAYLOAD] != 0;
+
+	atomic_set_bit_to(&heartbeat_conns, bt_conn_index(conn), enable);
+	return defer_request(conn, msg, enable);
+}
+
+static int cmd_perf_read(struct bt_conn *conn, const uint8_t *msg)
+{
+	return perf_request_report(conn);
+}
+
+static int cmd_perf_benchmark(struct bt_conn *conn, const uint8_t *msg)
+{
+	return perf_request_benchmark(conn, sys_get_be32(&msg[RUUVI_MSG_PAYLOAD]));
+}
+
+static int cmd_log_stream(struct bt_conn *conn, const uint8_t *msg)
+{
+	return nus_log_request_stream(conn, msg[RUUVI_MSG_PAYLOAD] != 0);
+}
+
+static int cmd_tx_power_ack(struct bt_conn *conn, const uint8_t *msg)
+{
+	return tx_power_ack(sys_get_be32(&msg[RUUVI_MSG_PAYLOAD]),
+			    (int32_t)sys_get_be32(&msg[RUUVI_MSG_PAYLOAD + 4]));
+}
+
+static int cmd_params(struct bt_conn *conn, const uint8_t *msg)
+{
+	return params_request(conn, msg);
+}
+
+static const nus_cmd_t commands[] = {
+	{RUUVI_ENDPOINT_ENVIRONMENTAL, RUUVI_OP_LOG_VALUE_READ, cmd_log_read},
+	{RUUVI_ENDPOINT_TEMPERATURE, RUUVI_OP_VALUE_READ, cmd_value_read},
+	{RUUVI_ENDPOINT_HUMIDITY, RUUVI_OP_VALUE_READ, cmd_value_read},
+	{RUUVI_ENDPOINT_ENVIRONMENTAL, RUUVI_OP_VALUE_READ, cmd_value_read},
+	{RUUVI_ENDPOINT_ENVIRONMENTAL, RUUVI_OP_HEARTBEAT, cmd_heartbeat},
+	{PERF_ENDPOINT, PERF_OP_READ, cmd_perf_read},
+	{PERF_ENDPOINT, PERF_OP_BENCHMARK, cmd_perf_benchmark},
+	{NUS_LOG_ENDPOINT, NUS_LOG_OP_STREAM, cmd_log_stream},
+	{TX_POWER_ENDPOINT, TX_POWER_OP_ACK, cmd_tx_power_ack},
+	{PARAMS_ENDPOINT, PARAMS_OP_CHALLENGE, cmd_params},
+	{PARAMS_ENDPOINT, PARAMS_OP_STAGE, cmd_params},
+	{PARAMS_ENDPOINT, PARAMS_OP_COMMIT, cmd_params},
+};
+
+void nus_cmd_dispatch(struct bt_conn *conn, const uint8_t *data, uint16_t len)
+{
+	if (len == 0 || len % RUUVI_MSG_LEN) {
+		LOG_WRN("invalid command length %u", len);
+		return;
+	}
+
+	for (const uint8_t *msg = data; msg < data + len; msg += RUUVI_MSG_LEN) {
+		const nus_cmd_t *cmd = NULL;
+		for (int i = 0; i < ARRAY_SIZE(commands); i++) {
+			if (commands[i].destination == msg[RUUVI_MSG_DESTINATION] &&
+			    commands[i].op == msg[RUUVI_MSG_OPERATION]) {
+				cmd = &commands[i];
+				break;
+			}
+		}
+		if (!cmd) {
+			LOG_WRN("unknown command %02X %02X", msg[RUUVI_MSG_DESTINATION],
+				msg[RUUVI_MSG_OPERATION]);
+			continue;
+		}
+		int err = cmd->handler(conn, msg);
+		if (err) {
+			LOG_WRN("command %02X %02X rejected, err %d", msg[RUUVI_MSG_DESTINATION],
+				msg[RUUVI_MSG_OPERATION], err);
+		}
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	atomic_clear_bit(&heartbeat_conns, bt_conn_index(conn));
+	k_work_submit_to_queue(&app_work_q, &cleanup_work);
+}
+
+BT_CONN_CB_DEFINE(nus_cmd_conn_callbacks) = {
+	.disconnected = disconnected,
+};
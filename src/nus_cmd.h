@@ -0,0 +1,118 @@
+/**
+ * @file
+ * @brief Ruuvi NUS command protocol.
+ *
+ * Every command and response is an 11 byte message: destination endpoint, source endpoint,
+ * operation and 8 bytes of payload (two 32bit big endian values). A single write may contain
+ * several messages, they are parsed in place from the RX buffer and dispatched by destination
+ * endpoint and operation. Handlers run in the BT RX thread, so they only validate the command and
+ * defer everything else to the application work queue.
+ *
+ * | Command    | Request                  | Response                                            |
+ * | ---------- | ------------------------ | --------------------------------------------------- |
+ * | log read   | 3A 3A 11 <now> <start>   | 3A 30/31 10 <time> <value> records, 3A 3A 10 FF..   |
+ * | value read | 30/31/3A 3A 01 <now> 00  | 3A 30/31 10 <now> <value>                           |
+ * | heartbeat  | 3A 3A 12 <on> 00..       | echo, then the RAWv2 payload (without company id)   |
+ * |            |                          | whenever the advertisement is updated               |
+ * | perf read  | FA FA 11 00..            | FA <id> 10 <u32> <u32> records, see perf.h          |
+ * | benchmark  | FA FA 20 <bytes> 00..    | <bytes> of test data, FA 70 10 <bytes> <ms>         |
+ * | log stream | FB FB 12 <on> 00..       | FB <dictionary log records>, see nus_log.h          |
+ * | TX ack     | FC FC 13 <seq> <rssi>    | none, see tx_power.h                                |
+ * | challenge  | FD FD 01 00..            | FD FD 01 <8 byte nonce>, see params.h               |
+ * | param data | FD FD 20 <id> <off> <6B> | none, stages a part of a parameter value            |
+ * | param set  | FD FD 21 <id> <len> <6B> | FD FD 21 <id> <errno>, 6 byte HMAC tag              |
+ *
+ * Temperatures are sent in 0.01 degree, humidities in 0.01% steps. The value read and heartbeat
+ * commands are specific to this firmware. With CONFIG_ADV_ENCRYPTION, the log read and value read
+ * commands are rejected unless the connection is encrypted (BT_SECURITY_L2 or higher).
+ *
+ * Responses are batched: messages are appended to a per connection buffer of a net_buf pool and
+ * sent with bt_nus_send() once the negotiated MTU is reached or the response is complete.
+ * see https://docs.ruuvi.com/communication/bluetooth-connection/nordic-uart-service-nus
+ */
+
+#ifndef NUS_CMD_H
+#define NUS_CMD_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/conn.h>
+#include <bluetooth/services/nus.h>
+
+#include <autoconf.h>
+
+#include "history.h"
+#include "nus_log.h"
+#include "params.h"
+#include "perf.h"
+#include "scheduler.h"
+#include "sensors.h"
+#include "tx_power.h"
+
+// Ruuvi endpoints and operations
+#define RUUVI_ENDPOINT_TEMPERATURE   0x30
+#define RUUVI_ENDPOINT_HUMIDITY      0x31
+#define RUUVI_ENDPOINT_ENVIRONMENTAL 0x3A
+#define RUUVI_OP_VALUE_READ          0x01
+#define RUUVI_OP_LOG_VALUE_WRITE     0x10
+#define RUUVI_OP_LOG_VALUE_READ      0x11
+#define RUUVI_OP_HEARTBEAT           0x12
+// length of a single command or response message
+#define RUUVI_MSG_LEN                11
+#define RUUVI_LOG_MSG_LEN            RUUVI_MSG_LEN
+
+// message layout
+#define RUUVI_MSG_DESTINATION 0
+#define RUUVI_MSG_SOURCE      1
+#define RUUVI_MSG_OPERATION   2
+#define RUUVI_MSG_PAYLOAD     3
+
+/**
+ * @brief write a message with two 32bit values into the given buffer (RUUVI_MSG_LEN bytes).
+ */
+static inline void nus_msg_put(uint8_t *msg, uint8_t destination, uint8_t source, uint8_t op,
+			       uint32_t first, uint32_t second)
+{
+	msg[RUUVI_MSG_DESTINATION] = destination;
+	msg[RUUVI_MSG_SOURCE] = source;
+	msg[RUUVI_MSG_OPERATION] = op;
+	sys_put_be32(first, &msg[RUUVI_MSG_PAYLOAD]);
+	sys_put_be32(second, &msg[RUUVI_MSG_PAYLOAD + 4]);
+}
+
+/**
+ * @brief parse and dispatch the commands of a NUS write, called from the NUS RX callback.
+ */
+void nus_cmd_dispatch(struct bt_conn *conn, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief append a message to the pending TX buffer of the given connection.
+ *
+ * If the message does not fit into the negotiated MTU anymore, the pending buffer is sent first.
+ * Must only be called from the application work queue.
+ *
+ * @return 1 if a full batch has been sent, 0 if the message has only been buffered, negative
+ * error code otherwise
+ */
+int nus_send(struct bt_conn *conn, const uint8_t *msg, size_t len);
+
+/**
+ * @brief send the pending TX buffer of the given connection, if any.
+ *
+ * Must only be called from the application work queue.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int nus_flush(struct bt_conn *conn);
+
+/**
+ * @brief send the given advertisement payload to all connections with the heartbeat enabled.
+ *
+ * Must only be called from the application work queue.
+ */
+void nus_heartbeat(const uint8_t *payload, size_t len);
+
+#endif // NUS_CMD_H
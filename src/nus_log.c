@@ -0,0 +1,181 @@
+#include "nus_log.h"
+
+// this module does not log itself, its messages would feed back into the stream
+
+#define NUS_LOG_PACKET_LEN    (CONFIG_BT_L2CAP_TX_MTU - 3)
+#define NUS_LOG_OUTPUT_LEN    64
+#define NUS_LOG_REQUEST_Q_LEN 4
+
+typedef struct {
+	struct bt_conn *conn;
+	bool enable;
+} nus_log_request_t;
+
+RING_BUF_DECLARE(stream_buf, CONFIG_NUS_LOG_BUF_SIZE);
+static struct k_spinlock stream_lock;
+static uint32_t dropped;
+
+// connection receiving the stream, only accessed from the application work queue
+static struct bt_conn *stream_conn;
+static uint8_t packet[NUS_LOG_PACKET_LEN];
+
+K_MSGQ_DEFINE(request_q, sizeof(nus_log_request_t), NUS_LOG_REQUEST_Q_LEN, 4);
+
+static void request_work_handler(struct k_work *work);
+static void send_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(request_work, request_work_handler);
+static K_WORK_DEFINE(send_work, send_work_handler);
+
+// the log output hands over a record in chunks, it is assembled here and then added to the stream
+// or dropped as a whole, so the host never receives a partial record. Only accessed from the log
+// processing thread (deferred mode).
+static uint8_t record[CONFIG_NUS_LOG_RECORD_MAX_LEN];
+static size_t record_len;
+static bool record_truncated;
+
+static int output_func(uint8_t *data, size_t length, void *ctx)
+{
+	if (record_len + length > sizeof(record)) {
+		record_truncated = true;
+	} else {
+		memcpy(&record[record_len], data, length);
+		record_len += length;
+	}
+	return length;
+}
+
+static uint8_t output_buf[NUS_LOG_OUTPUT_LEN];
+LOG_OUTPUT_DEFINE(nus_log_output, output_func, output_buf, sizeof(output_buf));
+
+static void record_commit(void)
+{
+	log_output_flush(&nus_log_output);
+	K_SPINLOCK(&stream_lock) {
+		if (!record_truncated && ring_buf_space_get(&stream_buf) >= record_len) {
+			ring_buf_put(&stream_buf, record, record_len);
+		} else {
+			dropped++;
+		}
+	}
+	record_len = 0;
+	record_truncated = false;
+}
+
+static void process(const struct log_backend *const backend, union log_msg_generic *msg)
+{
+	uint32_t count;
+
+	K_SPINLOCK(&stream_lock) {
+		count = dropped;
+		dropped = 0;
+	}
+	if (count) {
+		log_dict_output_dropped_process(&nus_log_output, count);
+		record_commit();
+	}
+	log_dict_output_msg_process(&nus_log_output, &msg->log, 0);
+	record_commit();
+	k_work_submit_to_queue(&app_work_q, &send_work);
+}
+
+static void dropped_cb(const struct log_backend *const backend, uint32_t cnt)
+{
+	K_SPINLOCK(&stream_lock) {
+		dropped += cnt;
+	}
+}
+
+// nothing can be sent once the system panics
+static void panic(const struct log_backend *const backend)
+{
+	log_backend_disable(backend);
+}
+
+static const struct log_backend_api nus_log_backend_api = {
+	.process = process,
+	.dropped = dropped_cb,
+	.panic = panic,
+};
+
+// only enabled while a client is connected and has requested the stream
+LOG_BACKEND_DEFINE(nus_log_backend, nus_log_backend_api, false);
+
+static void stream_stop(void)
+{
+	if (!stream_conn) {
+		return;
+	}
+	log_backend_disable(&nus_log_backend);
+	K_SPINLOCK(&stream_lock) {
+		ring_buf_reset(&stream_buf);
+		dropped = 0;
+	}
+	bt_conn_unref(stream_conn);
+	stream_conn = NULL;
+}
+
+static void request_work_handler(struct k_work *work)
+{
+	nus_log_request_t request;
+
+	while (k_msgq_get(&request_q, &request, K_NO_WAIT) == 0) {
+		if (request.enable && request.conn != stream_conn) {
+			stream_stop();
+			stream_conn = bt_conn_ref(request.conn);
+			log_backend_enable(&nus_log_backend, NULL, LOG_LEVEL_DBG);
+		} else if (!request.enable && request.conn == stream_conn) {
+			stream_stop();
+		}
+		bt_conn_unref(request.conn);
+	}
+}
+
+static void send_work_handler(struct k_work *work)
+{
+	uint32_t len;
+
+	if (!stream_conn) {
+		return;
+	}
+	size_t mtu = MIN(bt_nus_get_mtu(stream_conn), sizeof(packet));
+
+	packet[0] = NUS_LOG_ENDPOINT;
+	do {
+		K_SPINLOCK(&stream_lock) {
+			len = ring_buf_get(&stream_buf, &packet[1], mtu - 1);
+		}
+		if (len && bt_nus_send(stream_conn, packet, len + 1)) {
+			// the client is gone or does not keep up, the buffered records are dropped
+			K_SPINLOCK(&stream_lock) {
+				ring_buf_reset(&stream_buf);
+				dropped++;
+			}
+			return;
+		}
+	} while (len);
+}
+
+int nus_log_request_stream(struct bt_conn *conn, bool enable)
+{
+	nus_log_request_t request = {
+		.conn = bt_conn_ref(conn),
+		.enable = enable,
+	};
+
+	if (k_msgq_put(&request_q, &request, K_NO_WAIT)) {
+		bt_conn_unref(conn);
+		return -EBUSY;
+	}
+	k_work_submit_to_queue(&app_work_q, &request_work);
+	return 0;
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	nus_log_request_stream(conn, false);
+}
+
+BT_CONN_CB_DEFINE(nus_log_conn_callbacks) = {
+	.disconnected = disconnected,
+};
@@ -0,0 +1,60 @@
+/**
+ * @file
+ * @brief Log backend streaming dictionary log records to a NUS client.
+ *
+ * With dictionary logging, log messages are not formatted on the device: each record only holds
+ * the address of the format string and the raw arguments, the strings are resolved on the host
+ * using the log_dictionary.json database generated with the build.
+ *
+ * A client enables the stream with FB FB 12 01 (padded to 11 bytes) and disables it with
+ * FB FB 12 00, only a single connection receives the stream. The records are buffered and sent
+ * from the application work queue, each notification starts with NUS_LOG_ENDPOINT followed by the
+ * next bytes of the record stream. Each record is assembled completely before it is added to the
+ * buffer (up to CONFIG_NUS_LOG_RECORD_MAX_LEN bytes), records which are longer or do not fit into
+ * the buffer are dropped as a whole and reported as dropped messages.
+ */
+
+#ifndef NUS_LOG_H
+#define NUS_LOG_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/ring_buffer.h>
+#include <zephyr/logging/log_backend.h>
+#include <zephyr/logging/log_output.h>
+#include <zephyr/logging/log_output_dict.h>
+#include <zephyr/bluetooth/conn.h>
+#include <bluetooth/services/nus.h>
+
+#include <string.h>
+#include <autoconf.h>
+
+#include "scheduler.h"
+
+// vendor specific endpoint of the log stream, uses the Ruuvi message layout (nus_cmd.h)
+#define NUS_LOG_ENDPOINT  0xFB
+#define NUS_LOG_OP_STREAM 0x12
+
+#ifdef CONFIG_NUS_LOG_BACKEND
+
+/**
+ * @brief enable or disable the log stream to the given connection.
+ *
+ * Enabling the stream for another connection moves it there. Can be called from any thread.
+ *
+ * @return 0 if the request has been queued, -EBUSY if too many requests are pending
+ */
+int nus_log_request_stream(struct bt_conn *conn, bool enable);
+
+#else
+
+static inline int nus_log_request_stream(struct bt_conn *conn, bool enable)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(enable);
+	return -ENOTSUP;
+}
+
+#endif // CONFIG_NUS_LOG_BACKEND
+
+#endif // NUS_LOG_H
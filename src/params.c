@@ -0,0 +1,488 @@
+#include "params.h"
+#include "ble.h"
+
+LOG_MODULE_REGISTER(params);
+
+#define NONCE_LEN          8
+#define TAG_LEN            6
+#define STAGE_CHUNK_LEN    6
+#define REQUEST_QUEUE_LEN  4
+#define MAC_ALG            PSA_ALG_TRUNCATED_MAC(PSA_ALG_HMAC(PSA_ALG_SHA_256), TAG_LEN)
+#define STRING_INDEX(_id)  ((_id) - PARAM_FIRST_STRING)
+#define IS_STRING(_id)     ((_id) >= PARAM_FIRST_STRING)
+
+#ifdef CONFIG_MEASUREMENT_JITTER
+#define JITTER_MS CONFIG_MEASUREMENT_JITTER_MS
+#else
+#define JITTER_MS 0
+#endif
+
+// message layout of the stage and commit operations
+#define MSG_ID        RUUVI_MSG_PAYLOAD
+#define MSG_OFFSET    (RUUVI_MSG_PAYLOAD + 1)
+#define MSG_VALUE_LEN (RUUVI_MSG_PAYLOAD + 1)
+#define MSG_DATA      (RUUVI_MSG_PAYLOAD + 2)
+
+BUILD_ASSERT(sizeof(CONFIG_BT_DEVICE_NAME) - 1 <= PARAMS_NAME_MAX_LEN,
+	     "the device name does not fit into the name parameter");
+BUILD_ASSERT(sizeof(CONFIG_MANUFACTURER_NAME) - 1 <= PARAMS_STRING_MAX_LEN &&
+		     sizeof(CONFIG_MODEL_NUMBER) - 1 <= PARAMS_STRING_MAX_LEN &&
+		     sizeof(CONFIG_SERIAL_NUMBER) - 1 <= PARAMS_STRING_MAX_LEN &&
+		     sizeof(CONFIG_HW_REV) - 1 <= PARAMS_STRING_MAX_LEN,
+	     "the DIS strings do not fit into their parameters");
+
+typedef struct {
+	// settings key below PARAMS_SETTINGS
+	const char *name;
+	// valid range of a number, maximum length of a string
+	int32_t min;
+	int32_t max;
+} param_info_t;
+
+static const param_info_t params[PARAM_COUNT] = {
+	// the minimum is raised to the one of the sensor, see min_value()
+	[PARAM_MEASUREMENT_INTERVAL_SEC] = {"interval", 5, 3600},
+	[PARAM_ADV_INTERVAL_FAST_MS] = {"adv_fast", 20, 8000},
+	[PARAM_ADV_INTERVAL_SLOW_MS] = {"adv_slow", 20, 8000},
+	[PARAM_ADV_FAST_DURATION_SEC] = {"fast_duration", 0, 3600},
+	[PARAM_TX_POWER_DBM] = {"tx_power", -40, CONFIG_BT_CTLR_TX_PWR_DBM},
+	[PARAM_DEVICE_NAME] = {"name", 1, PARAMS_NAME_MAX_LEN},
+	[PARAM_MANUFACTURER_NAME] = {"manufacturer", 1, PARAMS_STRING_MAX_LEN},
+	[PARAM_MODEL_NUMBER] = {"model", 1, PARAMS_STRING_MAX_LEN},
+	[PARAM_SERIAL_NUMBER] = {"serial", 1, PARAMS_STRING_MAX_LEN},
+	[PARAM_HW_REV] = {"hw_rev", 1, PARAMS_STRING_MAX_LEN},
+};
+
+// cached values, written from the application work queue (and init), read from any thread
+static atomic_t numbers[PARAM_FIRST_STRING] = {
+	[PARAM_MEASUREMENT_INTERVAL_SEC] = ATOMIC_INIT(CONFIG_MEASUREMENT_INTERVAL_SEC),
+	[PARAM_ADV_INTERVAL_FAST_MS] = ATOMIC_INIT(CONFIG_ADV_INTERVAL_FAST_MS),
+	[PARAM_ADV_INTERVAL_SLOW_MS] = ATOMIC_INIT(CONFIG_ADV_INTERVAL_SLOW_MS),
+	[PARAM_ADV_FAST_DURATION_SEC] = ATOMIC_INIT(CONFIG_ADV_FAST_DURATION_SEC),
+	[PARAM_TX_POWER_DBM] = ATOMIC_INIT(CONFIG_BT_CTLR_TX_PWR_DBM),
+};
+static char strings[PARAM_COUNT - PARAM_FIRST_STRING][PARAMS_STRING_MAX_LEN + 1] = {
+	[STRING_INDEX(PARAM_DEVICE_NAME)] = CONFIG_BT_DEVICE_NAME,
+	[STRING_INDEX(PARAM_MANUFACTURER_NAME)] = CONFIG_MANUFACTURER_NAME,
+	[STRING_INDEX(PARAM_MODEL_NUMBER)] = CONFIG_MODEL_NUMBER,
+	[STRING_INDEX(PARAM_SERIAL_NUMBER)] = CONFIG_SERIAL_NUMBER,
+	[STRING_INDEX(PARAM_HW_REV)] = CONFIG_HW_REV,
+};
+static struct k_spinlock strings_lock;
+
+// write session of a connection, indexed by bt_conn_index(), only accessed from the application
+// work queue
+static struct {
+	uint8_t nonce[NONCE_LEN];
+	bool nonce_valid;
+	uint8_t id;
+	uint8_t value[PARAMS_STRING_MAX_LEN];
+} sessions[CONFIG_BT_MAX_CONN];
+
+// sessions of disconnected connections, reset before the next request of the slot is handled
+static atomic_t stale_sessions = ATOMIC_INIT(0);
+
+// command deferred to the application work queue, holds a reference to the connection
+typedef struct {
+	struct bt_conn *conn;
+	uint8_t msg[RUUVI_MSG_LEN];
+} params_request_t;
+
+static psa_key_id_t key_id = PSA_KEY_ID_NULL;
+// key written by the shell, imported on the application work queue
+static uint8_t new_key[PARAMS_KEY_LEN];
+
+K_MSGQ_DEFINE(params_q, sizeof(params_request_t), REQUEST_QUEUE_LEN, 4);
+
+static void request_work_handler(struct k_work *work);
+static void key_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(request_work, request_work_handler);
+static K_WORK_DEFINE(key_work, key_work_handler);
+
+int32_t params_get(param_id_t id)
+{
+	return atomic_get(&numbers[id]);
+}
+
+void params_get_string(param_id_t id, char *buf, size_t size)
+{
+	k_spinlock_key_t key = k_spin_lock(&strings_lock);
+	strncpy(buf, strings[STRING_INDEX(id)], size - 1);
+	k_spin_unlock(&strings_lock, key);
+	buf[size - 1] = '\0';
+}
+
+// the reads of an interval must not be closer than the minimum of the sensor, even with the
+// largest negative jitter (scheduler.c)
+static int32_t min_value(param_id_t id)
+{
+	if (id != PARAM_MEASUREMENT_INTERVAL_SEC) {
+		return params[id].min;
+	}
+	int32_t min_ms = CONFIG_OVERSAMPLING_COUNT * (sensor_min_interval_ms() + JITTER_MS / 2);
+	return MAX(params[id].min, DIV_ROUND_UP(min_ms, MSEC_PER_SEC));
+}
+
+// checks and caches a new value, numbers are 32bit big endian, strings are not NUL terminated
+static int set_value(param_id_t id, const uint8_t *value, size_t len)
+{
+	const param_info_t *info = &params[id];
+
+	if (IS_STRING(id)) {
+		if (len < info->min || len > info->max || memchr(value, '\0', len)) {
+			return -EINVAL;
+		}
+		k_spinlock_key_t key = k_spin_lock(&strings_lock);
+		memcpy(strings[STRING_INDEX(id)], value, len);
+		strings[STRING_INDEX(id)][len] = '\0';
+		k_spin_unlock(&strings_lock, key);
+		return 0;
+	}
+	if (len != sizeof(uint32_t)) {
+		return -EINVAL;
+	}
+	int32_t number = (int32_t)sys_get_be32(value);
+	if (number < min_value(id) || number > info->max) {
+		return -ERANGE;
+	}
+	atomic_set(&numbers[id], number);
+	return 0;
+}
+
+// hands a changed value over to the module using it, on the application work queue (and init)
+static void apply_value(param_id_t id)
+{
+	switch (id) {
+	case PARAM_TX_POWER_DBM:
+		tx_power_set_max(params_get(id));
+		break;
+	case PARAM_ADV_INTERVAL_FAST_MS:
+	case PARAM_ADV_INTERVAL_SLOW_MS:
+	case PARAM_DEVICE_NAME:
+		apply_advertising_params();
+		break;
+	default:
+		// read whenever they are used
+		break;
+	}
+}
+
+static int import_key(const uint8_t *key)
+{
+	psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+
+	if (key_id != PSA_KEY_ID_NULL) {
+		psa_destroy_key(key_id);
+		key_id = PSA_KEY_ID_NULL;
+	}
+
+	psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_VERIFY_MESSAGE);
+	psa_set_key_lifetime(&attributes, PSA_KEY_LIFETIME_VOLATILE);
+	psa_set_key_algorithm(&attributes, MAC_ALG);
+	psa_set_key_type(&attributes, PSA_KEY_TYPE_HMAC);
+	psa_set_key_bits(&attributes, PARAMS_KEY_LEN * 8);
+
+	psa_status_t status = psa_import_key(&attributes, key, PARAMS_KEY_LEN, &key_id);
+	psa_reset_key_attributes(&attributes);
+	if (status != PSA_SUCCESS) {
+		LOG_ERR("key import failed, status %d", status);
+		return -EIO;
+	}
+	return 0;
+}
+
+static int reply(struct bt_conn *conn, uint8_t op, const uint8_t *payload)
+{
+	uint8_t msg[RUUVI_MSG_LEN];
+
+	msg[RUUVI_MSG_DESTINATION] = PARAMS_ENDPOINT;
+	msg[RUUVI_MSG_SOURCE] = PARAMS_ENDPOINT;
+	msg[RUUVI_MSG_OPERATION] = op;
+	memcpy(&msg[RUUVI_MSG_PAYLOAD], payload, RUUVI_MSG_LEN - RUUVI_MSG_PAYLOAD);
+	int err = nus_send(conn, msg, sizeof(msg));
+	return err < 0 ? err : nus_flush(conn);
+}
+
+static int challenge(struct bt_conn *conn)
+{
+	uint8_t index = bt_conn_index(conn);
+
+	int err = sys_csrand_get(sessions[index].nonce, NONCE_LEN);
+	if (err) {
+		return err;
+	}
+	sessions[index].nonce_valid = true;
+	return reply(conn, PARAMS_OP_CHALLENGE, sessions[index].nonce);
+}
+
+static int stage(struct bt_conn *conn, const uint8_t *msg)
+{
+	uint8_t index = bt_conn_index(conn);
+	uint8_t offset = msg[MSG_OFFSET];
+
+	if (offset >= sizeof(sessions[index].value)) {
+		return -EINVAL;
+	}
+	if (sessions[index].id != msg[MSG_ID]) {
+		// a new value, nothing of the previous one is reused
+		sessions[index].id = msg[MSG_ID];
+		memset(sessions[index].value, 0, sizeof(sessions[index].value));
+	}
+	memcpy(&sessions[index].value[offset], &msg[MSG_DATA],
+	       MIN(STAGE_CHUNK_LEN, sizeof(sessions[index].value) - offset));
+	return 0;
+}
+
+// checks the tag of the staged value, the nonce is used up either way
+static int verify(uint8_t index, param_id_t id, uint8_t len, const uint8_t *tag)
+{
+	uint8_t input[NONCE_LEN + 2 + PARAMS_STRING_MAX_LEN];
+
+	if (!sessions[index].nonce_valid) {
+		return -EACCES;
+	}
+	sessions[index].nonce_valid = false;
+	if (key_id == PSA_KEY_ID_NULL) {
+		return -ENOKEY;
+	}
+	if (sessions[index].id != id || len > sizeof(sessions[index].value)) {
+		return -EINVAL;
+	}
+	memcpy(input, sessions[index].nonce, NONCE_LEN);
+	input[NONCE_LEN] = id;
+	input[NONCE_LEN + 1] = len;
+	memcpy(&input[NONCE_LEN + 2], sessions[index].value, len);
+
+	psa_status_t status = psa_mac_verify(key_id, MAC_ALG, input, NONCE_LEN + 2 + len, tag,
+					     TAG_LEN);
+	return status == PSA_SUCCESS ? 0 : -EPERM;
+}
+
+static int commit(struct bt_conn *conn, const uint8_t *msg)
+{
+	uint8_t index = bt_conn_index(conn);
+	param_id_t id = msg[MSG_ID];
+	uint8_t len = msg[MSG_VALUE_LEN];
+	char settings_key[sizeof(PARAMS_SETTINGS) + 16];
+	uint8_t payload[RUUVI_MSG_LEN - RUUVI_MSG_PAYLOAD];
+
+	int err = verify(index, id, len, &msg[MSG_DATA]);
+	if (!err && id == PARAM_TX_POWER_DBM && !IS_ENABLED(CONFIG_TX_POWER_ADAPTIVE)) {
+		err = -ENOTSUP;
+	}
+	if (!err) {
+		err = set_value(id, sessions[index].value, len);
+	}
+	if (!err) {
+		// applied even if it could not be stored, it is lost with the next reset then
+		apply_value(id);
+		snprintf(settings_key, sizeof(settings_key), PARAMS_SETTINGS "/%s",
+			 params[id].name);
+		err = settings_save_one(settings_key, sessions[index].value, len);
+	}
+	if (err) {
+		LOG_WRN("parameter %u rejected, err %d", id, err);
+	} else {
+		LOG_INF("parameter %s changed", params[id].name);
+	}
+
+	sys_put_be32(id, &payload[0]);
+	sys_put_be32(-err, &payload[4]);
+	return reply(conn, PARAMS_OP_COMMIT, payload);
+}
+
+static bool is_connected(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	return !bt_conn_get_info(conn, &info) && info.state == BT_CONN_STATE_CONNECTED;
+}
+
+static void request_work_handler(struct k_work *work)
+{
+	params_request_t request;
+
+	while (k_msgq_get(&params_q, &request, K_NO_WAIT) == 0) {
+		uint8_t index = bt_conn_index(request.conn);
+		int err = 0;
+
+		if (atomic_test_and_clear_bit(&stale_sessions, index)) {
+			memset(&sessions[index], 0, sizeof(sessions[index]));
+		}
+		if (!is_connected(request.conn)) {
+			// queued before the disconnect, the session is gone
+		} else if (request.msg[RUUVI_MSG_OPERATION] == PARAMS_OP_CHALLENGE) {
+			err = challenge(request.conn);
+		} else if (request.msg[RUUVI_MSG_OPERATION] == PARAMS_OP_STAGE) {
+			err = stage(request.conn, request.msg);
+		} else {
+			err = commit(request.conn, request.msg);
+		}
+		if (err < 0) {
+			LOG_WRN("parameter command %02X failed, err %d",
+				request.msg[RUUVI_MSG_OPERATION], err);
+		}
+		bt_conn_unref(request.conn);
+	}
+}
+
+int params_request(struct bt_conn *conn, const uint8_t *msg)
+{
+	params_request_t request = {
+		.conn = bt_conn_ref(conn),
+	};
+
+	if (msg[RUUVI_MSG_OPERATION] != PARAMS_OP_CHALLENGE && msg[MSG_ID] >= PARAM_COUNT) {
+		bt_conn_unref(conn);
+		return -EINVAL;
+	}
+	memcpy(request.msg, msg, RUUVI_MSG_LEN);
+	if (k_msgq_put(&params_q, &request, K_NO_WAIT)) {
+		bt_conn_unref(conn);
+		return -EBUSY;
+	}
+	k_work_submit_to_queue(&app_work_q, &request_work);
+	return 0;
+}
+
+static void key_work_handler(struct k_work *work)
+{
+	if (!import_key(new_key)) {
+		LOG_INF("new parameter key imported");
+	}
+	memset(new_key, 0, sizeof(new_key));
+}
+
+static int load_param_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+			 void *param)
+{
+	uint8_t value[PARAMS_STRING_MAX_LEN];
+	const char *next;
+
+	if (!key) {
+		return 0;
+	}
+	for (param_id_t id = 0; id < PARAM_COUNT; id++) {
+		if (!settings_name_steq(key, params[id].name, &next) || next) {
+			continue;
+		}
+		if (len > sizeof(value) || read_cb(cb_arg, value, len) != len) {
+			return -EIO;
+		}
+		if (set_value(id, value, len)) {
+			LOG_WRN("stored parameter %s is invalid, using the default",
+				params[id].name);
+		}
+		return 0;
+	}
+	// written by a firmware with other parameters
+	return 0;
+}
+
+static int load_key_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+		       void *param)
+{
+	if (len != PARAMS_KEY_LEN) {
+		return -EINVAL;
+	}
+	return read_cb(cb_arg, param, len) == len ? 0 : -EIO;
+}
+
+int init_params(void)
+{
+	uint8_t key[PARAMS_KEY_LEN];
+	bool found = false;
+	int err;
+
+	if (psa_crypto_init() != PSA_SUCCESS) {
+		LOG_ERR("PSA crypto init failed");
+		return -EIO;
+	}
+	err = settings_subsys_init();
+	if (err) {
+		LOG_ERR("settings init failed, err %d", err);
+		return err;
+	}
+	err = settings_load_subtree_direct(PARAMS_SETTINGS, load_param_cb, NULL);
+	if (err) {
+		LOG_WRN("parameters could not be loaded, err %d", err);
+	}
+	// BLE is not initialized yet, it picks the values up itself
+	tx_power_set_max(params_get(PARAM_TX_POWER_DBM));
+
+	memset(key, 0, sizeof(key));
+	err = settings_load_subtree_direct(PARAMS_KEY_SETTINGS, load_key_cb, key);
+	for (int i = 0; i < sizeof(key); i++) {
+		found |= key[i] != 0;
+	}
+	if (err || !found) {
+		LOG_WRN("no parameter key provisioned, parameters can not be changed");
+		return -ENOKEY;
+	}
+	err = import_key(key);
+	memset(key, 0, sizeof(key));
+	return err;
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	atomic_set_bit(&stale_sessions, bt_conn_index(conn));
+}
+
+BT_CONN_CB_DEFINE(params_conn_callbacks) = {
+	.disconnected = disconnected,
+};
+
+#ifdef CONFIG_SHELL
+
+static int cmd_params_show(const struct shell *sh, size_t argc, char **argv)
+{
+	char value[PARAMS_STRING_MAX_LEN + 1];
+
+	for (param_id_t id = 0; id < PARAM_COUNT; id++) {
+		if (IS_STRING(id)) {
+			params_get_string(id, value, sizeof(value));
+			shell_print(sh, "%2u %-14s '%s'", id, params[id].name, value);
+		} else {
+			shell_print(sh, "%2u %-14s %d", id, params[id].name, params_get(id));
+		}
+	}
+	return 0;
+}
+
+static int cmd_params_key(const struct shell *sh, size_t argc, char **argv)
+{
+	uint8_t key[PARAMS_KEY_LEN];
+
+	if (strlen(argv[1]) != 2 * PARAMS_KEY_LEN ||
+	    hex2bin(argv[1], strlen(argv[1]), key, sizeof(key)) != sizeof(key)) {
+		shell_error(sh, "the key must be %d hex digits", 2 * PARAMS_KEY_LEN);
+		return -EINVAL;
+	}
+	// the key is read by the work item until it finished, not only while it is queued
+	if (k_work_busy_get(&key_work)) {
+		shell_error(sh, "key change in progress");
+		return -EBUSY;
+	}
+	int err = settings_save_one(PARAMS_KEY_SETTINGS, key, sizeof(key));
+	if (err) {
+		shell_error(sh, "key could not be stored, err %d", err);
+		return err;
+	}
+	memcpy(new_key, key, sizeof(new_key));
+	memset(key, 0, sizeof(key));
+	k_work_submit_to_queue(&app_work_q, &key_work);
+	shell_print(sh, "key stored");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(params_cmds,
+			       SHELL_CMD(show, NULL, "Show the parameters", cmd_params_show),
+			       SHELL_CMD_ARG(key, NULL, "Store the parameter key <hex>",
+					     cmd_params_key, 2, 0),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(params, &params_cmds, "Runtime parameters", NULL);
+
+#endif // CONFIG_SHELL
@@ -0,0 +1,160 @@
+/**
+ * @file
+ * @brief Runtime parameters, stored in the settings and changed over NUS.
+ *
+ * The measurement and advertising intervals, the maximum TX power, the device name and the DIS
+ * strings default to their Kconfig values. With CONFIG_RUNTIME_PARAMS, they are cached in RAM,
+ * loaded from the settings (muuvi/params/<name>) at boot and can be changed by a NUS client
+ * holding the parameter key. Changes are stored and applied right away:
+ *
+ * | Parameter     | Applied                                                                  |
+ * | ------------- | ------------------------------------------------------------------------ |
+ * | interval      | with the next sensor read                                                |
+ * | adv fast/slow | right away in the slow phase, otherwise with the switch to the slow one  |
+ * | fast duration | with the next publish                                                    |
+ * | tx power      | maximum of the adaptive TX power, with the next payload (tx_power.h)     |
+ * | name          | in place with an advertising data update, without a restart              |
+ * | DIS strings   | with the next read of the characteristic                                 |
+ *
+ * The interval has to leave CONFIG_OVERSAMPLING_COUNT times the minimum read interval of the
+ * sensor plus half of CONFIG_MEASUREMENT_JITTER_MS for the reads (9s for a DHT22 with the
+ * defaults), shorter ones are rejected with -ERANGE.
+ *
+ * Writes are authenticated with a challenge-response, in the Ruuvi message layout (nus_cmd.h):
+ *
+ * 1. FD FD 01 00..                  -> FD FD 01 <8 byte nonce>, valid for one commit
+ * 2. FD FD 20 <id> <offset> <data>  stages up to 6 bytes of the value (numbers are 32bit BE)
+ * 3. FD FD 21 <id> <len> <tag>      -> FD FD 21 <id> <errno>, commits the staged value
+ *
+ * The tag is the HMAC-SHA256 (PSA Crypto) of nonce | id | len | value, truncated to 6 bytes. The
+ * 256bit key is provisioned with the `params key <64 hex digits>` shell command.
+ */
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/random/random.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include <string.h>
+#include <autoconf.h>
+
+#ifdef CONFIG_RUNTIME_PARAMS
+#include <psa/crypto.h>
+#endif
+
+#include "nus_cmd.h"
+#include "scheduler.h"
+#include "tx_power.h"
+
+// vendor specific endpoint of the parameter commands, uses the Ruuvi message layout (nus_cmd.h)
+#define PARAMS_ENDPOINT        0xFD
+#define PARAMS_OP_CHALLENGE    0x01
+#define PARAMS_OP_STAGE        0x20
+#define PARAMS_OP_COMMIT       0x21
+#define PARAMS_KEY_LEN         32
+#define PARAMS_KEY_SETTINGS    "muuvi/params_key"
+#define PARAMS_SETTINGS        "muuvi/params"
+#define PARAMS_STRING_MAX_LEN  24
+// leaves room for the MAC suffix and the TX power in the 31 byte scan response
+#define PARAMS_NAME_MAX_LEN    20
+
+typedef enum {
+	// numeric parameters
+	PARAM_MEASUREMENT_INTERVAL_SEC,
+	PARAM_ADV_INTERVAL_FAST_MS,
+	PARAM_ADV_INTERVAL_SLOW_MS,
+	PARAM_ADV_FAST_DURATION_SEC,
+	PARAM_TX_POWER_DBM,
+	// string parameters
+	PARAM_DEVICE_NAME,
+	PARAM_MANUFACTURER_NAME,
+	PARAM_MODEL_NUMBER,
+	PARAM_SERIAL_NUMBER,
+	PARAM_HW_REV,
+	PARAM_COUNT,
+} param_id_t;
+
+#define PARAM_FIRST_STRING PARAM_DEVICE_NAME
+
+#ifdef CONFIG_RUNTIME_PARAMS
+
+/**
+ * @brief load the parameters and the key from the settings.
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int init_params(void);
+
+/**
+ * @brief current value of a numeric parameter.
+ */
+int32_t params_get(param_id_t id);
+
+/**
+ * @brief copy the current value of a string parameter, NUL terminated. Can be called from any
+ * thread.
+ */
+void params_get_string(param_id_t id, char *buf, size_t size);
+
+/**
+ * @brief handle a parameter command, called from the NUS RX callback.
+ *
+ * @return 0 if the command has been queued, -EBUSY if too many commands are pending
+ */
+int params_request(struct bt_conn *conn, const uint8_t *msg);
+
+#else
+
+static inline int init_params(void)
+{
+	return -ENOTSUP;
+}
+
+static inline int32_t params_get(param_id_t id)
+{
+	switch (id) {
+	case PARAM_MEASUREMENT_INTERVAL_SEC:
+		return CONFIG_MEASUREMENT_INTERVAL_SEC;
+	case PARAM_ADV_INTERVAL_FAST_MS:
+		return CONFIG_ADV_INTERVAL_FAST_MS;
+	case PARAM_ADV_INTERVAL_SLOW_MS:
+		return CONFIG_ADV_INTERVAL_SLOW_MS;
+	case PARAM_ADV_FAST_DURATION_SEC:
+		return CONFIG_ADV_FAST_DURATION_SEC;
+	default:
+		return CONFIG_BT_CTLR_TX_PWR_DBM;
+	}
+}
+
+static inline void params_get_string(param_id_t id, char *buf, size_t size)
+{
+	static const char *const defaults[] = {
+		[PARAM_DEVICE_NAME - PARAM_FIRST_STRING] = CONFIG_BT_DEVICE_NAME,
+		[PARAM_MANUFACTURER_NAME - PARAM_FIRST_STRING] = CONFIG_MANUFACTURER_NAME,
+		[PARAM_MODEL_NUMBER - PARAM_FIRST_STRING] = CONFIG_MODEL_NUMBER,
+		[PARAM_SERIAL_NUMBER - PARAM_FIRST_STRING] = CONFIG_SERIAL_NUMBER,
+		[PARAM_HW_REV - PARAM_FIRST_STRING] = CONFIG_HW_REV,
+	};
+
+	strncpy(buf, defaults[id - PARAM_FIRST_STRING], size - 1);
+	buf[size - 1] = '\0';
+}
+
+static inline int params_request(struct bt_conn *conn, const uint8_t *msg)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(msg);
+	return -ENOTSUP;
+}
+
+#endif // CONFIG_RUNTIME_PARAMS
+
+#endif // PARAMS_H
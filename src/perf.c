@@ -0,0 +1,326 @@
+#include "perf.h"
+
+LOG_MODULE_REGISTER(perf);
+
+// record ids of the perf report, counters use their index directly
+#define PERF_ID_TIMER_AVG 0x40
+#define PERF_ID_TIMER_MAX 0x50
+#define PERF_ID_IDLE      0x60
+#define PERF_ID_THREAD    0x80
+#define PERF_ID_BENCHMARK 0x70
+#define PERF_MAX_THREADS  16
+// largest NUS payload and number of packets sent per benchmark work item run
+#define PERF_BENCHMARK_PACKET_LEN  (CONFIG_BT_L2CAP_TX_MTU - 3)
+#define PERF_BENCHMARK_PACKETS_RUN 16
+#define PERF_BENCHMARK_MAX_BYTES   (1024 * 1024)
+
+static const char *const counter_names[PERF_COUNTER_COUNT] = {
+	[PERF_ADV_CYCLES] = "adv cycles",
+	[PERF_ADV_UPDATE_FAILURES] = "adv update failures",
+	[PERF_ADV_START_FAILURES] = "adv start failures",
+	[PERF_LED_WAKEUPS] = "led wakeups",
+	[PERF_CONNECTIONS] = "connections",
+	[PERF_CONNECTION_FAILURES] = "connection failures",
+	[PERF_DISCONNECTIONS] = "disconnections",
+	[PERF_DHT_MISSED_EDGES] = "dht missed edges",
+	[PERF_ADV_RESTARTS] = "adv restarts",
+	[PERF_GATEWAY_RECEIVED] = "gateway received",
+	[PERF_GATEWAY_FORWARDED] = "gateway forwarded",
+	[PERF_GATEWAY_DROPPED] = "gateway dropped",
+};
+
+static const char *const timer_names[PERF_TIMER_COUNT] = {
+	[PERF_TIMER_SENSOR_READ] = "sensor read",
+	[PERF_TIMER_ADV_UPDATE] = "adv update",
+	[PERF_TIMER_ADV_RESTART] = "adv restart",
+	[PERF_TIMER_SAMPLE_TO_ADV] = "sample to adv",
+	[PERF_TIMER_LED_ACTIVE] = "led active",
+	[PERF_TIMER_KEYSTREAM] = "adv keystream",
+	[PERF_TIMER_BATTERY_READ] = "battery read",
+	[PERF_TIMER_ACCEL_FIFO] = "accel fifo read",
+};
+
+typedef struct {
+	uint32_t count;
+	uint64_t total_cycles;
+	uint32_t max_cycles;
+} perf_timer_stats_t;
+
+typedef struct {
+	const char *name;
+	size_t size;
+	size_t used;
+} perf_thread_stats_t;
+
+typedef struct {
+	perf_thread_stats_t *threads;
+	size_t count;
+} perf_thread_ctx_t;
+
+static atomic_t counters[PERF_COUNTER_COUNT];
+static perf_timer_stats_t timers[PERF_TIMER_COUNT];
+static struct k_spinlock timers_lock;
+
+// pending NUS report
+static struct bt_conn *report_conn;
+static atomic_t report_busy = ATOMIC_INIT(0);
+
+static void report_work_handler(struct k_work *work);
+static K_WORK_DEFINE(report_work, report_work_handler);
+
+// running NUS throughput benchmark, only accessed from the application work queue
+static struct {
+	struct bt_conn *conn;
+	uint32_t remaining;
+	uint32_t sent;
+	int64_t start;
+	uint8_t packet[PERF_BENCHMARK_PACKET_LEN];
+} benchmark;
+static atomic_t benchmark_busy = ATOMIC_INIT(0);
+
+static void benchmark_work_handler(struct k_work *work);
+static K_WORK_DEFINE(benchmark_work, benchmark_work_handler);
+
+void perf_inc(perf_counter_t counter)
+{
+	atomic_inc(&counters[counter]);
+}
+
+void perf_timer_stop(perf_timer_t timer, uint32_t start)
+{
+	uint32_t cycles = k_cycle_get_32() - start;
+
+	K_SPINLOCK(&timers_lock) {
+		timers[timer].count++;
+		timers[timer].total_cycles += cycles;
+		timers[timer].max_cycles = MAX(timers[timer].max_cycles, cycles);
+	}
+}
+
+static void get_timer(perf_timer_t timer, uint32_t *count, uint32_t *avg_us, uint32_t *max_us)
+{
+	perf_timer_stats_t stats;
+
+	K_SPINLOCK(&timers_lock) {
+		stats = timers[timer];
+	}
+	*count = stats.count;
+	*avg_us = stats.count ? k_cyc_to_us_floor32(stats.total_cycles / stats.count) : 0;
+	*max_us = k_cyc_to_us_floor32(stats.max_cycles);
+}
+
+// CPU idle time since boot in 0.1% steps
+static uint32_t get_idle_permille(void)
+{
+	k_thread_runtime_stats_t stats;
+
+	if (k_thread_runtime_stats_all_get(&stats) || stats.execution_cycles == 0) {
+		return 0;
+	}
+	return (uint32_t)((stats.idle_cycles * 1000) / stats.execution_cycles);
+}
+
+static void thread_cb(const struct k_thread *thread, void *user_data)
+{
+	perf_thread_ctx_t *ctx = user_data;
+	size_t unused;
+
+	if (ctx->count >= PERF_MAX_THREADS || k_thread_stack_space_get(thread, &unused)) {
+		return;
+	}
+	perf_thread_stats_t *stats = &ctx->threads[ctx->count++];
+	stats->name = k_thread_name_get((k_tid_t)thread);
+	stats->size = thread->stack_info.size;
+	stats->used = thread->stack_info.size - unused;
+}
+
+static size_t get_threads(perf_thread_stats_t *threads)
+{
+	perf_thread_ctx_t ctx = {threads, 0};
+
+	k_thread_foreach_unlocked(thread_cb, &ctx);
+	return ctx.count;
+}
+
+// append a record to the pending NUS batch
+static int send_record(uint8_t id, uint32_t aux, uint32_t value)
+{
+	uint8_t msg[PERF_MSG_LEN];
+
+	nus_msg_put(msg, PERF_ENDPOINT, id, PERF_OP_VALUE, aux, value);
+	return nus_send(report_conn, msg, sizeof(msg));
+}
+
+static int send_report(void)
+{
+	perf_thread_stats_t threads[PERF_MAX_THREADS];
+	uint32_t count, avg_us, max_us;
+	int err;
+
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		err = send_record(i, 0, atomic_get(&counters[i]));
+		if (err < 0) {
+			return err;
+		}
+	}
+	for (int i = 0; i < PERF_TIMER_COUNT; i++) {
+		get_timer(i, &count, &avg_us, &max_us);
+		err = send_record(PERF_ID_TIMER_AVG + i, count, avg_us);
+		if (err >= 0) {
+			err = send_record(PERF_ID_TIMER_MAX + i, count, max_us);
+		}
+		if (err < 0) {
+			return err;
+		}
+	}
+	err = send_record(PERF_ID_IDLE, 0, get_idle_permille());
+	if (err < 0) {
+		return err;
+	}
+	size_t thread_count = get_threads(threads);
+	for (int i = 0; i < thread_count; i++) {
+		err = send_record(PERF_ID_THREAD + i, threads[i].size, threads[i].used);
+		if (err < 0) {
+			return err;
+		}
+	}
+	return nus_flush(report_conn);
+}
+
+static void report_work_handler(struct k_work *work)
+{
+	int err = send_report();
+	if (err < 0) {
+		LOG_WRN("perf report aborted, err %d", err);
+	}
+
+	bt_conn_unref(report_conn);
+	report_conn = NULL;
+	atomic_clear(&report_busy);
+}
+
+int perf_request_report(struct bt_conn *conn)
+{
+	if (!atomic_cas(&report_busy, 0, 1)) {
+		return -EBUSY;
+	}
+	report_conn = bt_conn_ref(conn);
+	k_work_submit_to_queue(&app_work_q, &report_work);
+	return 0;
+}
+
+static void benchmark_finish(int err)
+{
+	uint32_t duration_ms = k_uptime_get() - benchmark.start;
+
+	if (!err) {
+		LOG_INF("benchmark: %u bytes in %ums, %u kbit/s", benchmark.sent, duration_ms,
+			duration_ms ? (uint32_t)((uint64_t)benchmark.sent * 8 / duration_ms) : 0);
+		uint8_t msg[PERF_MSG_LEN];
+		nus_msg_put(msg, PERF_ENDPOINT, PERF_ID_BENCHMARK, PERF_OP_VALUE, benchmark.sent,
+			    duration_ms);
+		err = nus_send(benchmark.conn, msg, sizeof(msg));
+		if (err >= 0) {
+			err = nus_flush(benchmark.conn);
+		}
+	}
+	if (err < 0) {
+		LOG_WRN("benchmark aborted after %u bytes, err %d", benchmark.sent, err);
+	}
+	bt_conn_unref(benchmark.conn);
+	benchmark.conn = NULL;
+	atomic_clear(&benchmark_busy);
+}
+
+// sends a limited number of MTU sized packets per run, so measurements are not delayed
+static void benchmark_work_handler(struct k_work *work)
+{
+	size_t mtu = MIN(bt_nus_get_mtu(benchmark.conn), sizeof(benchmark.packet));
+
+	for (int i = 0; i < PERF_BENCHMARK_PACKETS_RUN && benchmark.remaining > 0; i++) {
+		size_t len = MIN(mtu, benchmark.remaining);
+		// running byte counter, so the receiver can verify the data
+		for (size_t j = 0; j < len; j++) {
+			benchmark.packet[j] = (benchmark.sent + j) & 0xFF;
+		}
+		int err = bt_nus_send(benchmark.conn, benchmark.packet, len);
+		if (err) {
+			benchmark_finish(err);
+			return;
+		}
+		benchmark.sent += len;
+		benchmark.remaining -= len;
+	}
+	if (benchmark.remaining == 0) {
+		benchmark_finish(0);
+		return;
+	}
+	k_work_submit_to_queue(&app_work_q, &benchmark_work);
+}
+
+int perf_request_benchmark(struct bt_conn *conn, uint32_t bytes)
+{
+	if (bytes == 0 || bytes > PERF_BENCHMARK_MAX_BYTES) {
+		return -EINVAL;
+	}
+	if (!atomic_cas(&benchmark_busy, 0, 1)) {
+		return -EBUSY;
+	}
+	benchmark.conn = bt_conn_ref(conn);
+	benchmark.remaining = bytes;
+	benchmark.sent = 0;
+	benchmark.start = k_uptime_get();
+	LOG_INF("benchmark of %u bytes requested", bytes);
+	k_work_submit_to_queue(&app_work_q, &benchmark_work);
+	return 0;
+}
+
+#ifdef CONFIG_SHELL
+
+static int cmd_perf_show(const struct shell *sh, size_t argc, char **argv)
+{
+	perf_thread_stats_t threads[PERF_MAX_THREADS];
+	uint32_t count, avg_us, max_us;
+
+	shell_print(sh, "counters:");
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		shell_print(sh, "  %-20s %10u", counter_names[i],
+			    (uint32_t)atomic_get(&counters[i]));
+	}
+	shell_print(sh, "timers:                     count     avg us     max us");
+	for (int i = 0; i < PERF_TIMER_COUNT; i++) {
+		get_timer(i, &count, &avg_us, &max_us);
+		shell_print(sh, "  %-20s %10u %10u %10u", timer_names[i], count, avg_us, max_us);
+	}
+	shell_print(sh, "threads:                     used       size");
+	size_t thread_count = get_threads(threads);
+	for (int i = 0; i < thread_count; i++) {
+		shell_print(sh, "  %-20s %10zu %10zu", threads[i].name ? threads[i].name : "?",
+			    threads[i].used, threads[i].size);
+	}
+	uint32_t idle = get_idle_permille();
+	shell_print(sh, "cpu idle: %u.%u%%", idle / 10, idle % 10);
+	return 0;
+}
+
+static int cmd_perf_reset(const struct shell *sh, size_t argc, char **argv)
+{
+	for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+		atomic_clear(&counters[i]);
+	}
+	K_SPINLOCK(&timers_lock) {
+		memset(timers, 0, sizeof(timers));
+	}
+	shell_print(sh, "perf counters reset");
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(perf_cmds,
+			       SHELL_CMD(show, NULL, "Show counters, timers and threads",
+					 cmd_perf_show),
+			       SHELL_CMD(reset, NULL, "Reset counters and timers", cmd_perf_reset),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(perf, &perf_cmds, "Performance counters", NULL);
+
+#endif // CONFIG_SHELL
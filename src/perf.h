@@ -0,0 +1,155 @@
+/**
+ * @file
+ * @brief Runtime performance and energy counters.
+ *
+ * Counters are incremented at the relevant places of the firmware, timers track the number of
+ * invocations, the average and the maximum duration of a code section. Together with the thread
+ * stack high-water marks and the CPU idle percentage they can be queried using the `perf` shell
+ * command or the perf read command over NUS.
+ *
+ * The NUS throughput benchmark (FA FA 20 <bytes> 00..) sends the requested number of bytes in MTU
+ * sized packets, followed by a record with the number of bytes and the duration in ms
+ * (FA 70 10 <bytes> <ms>).
+ *
+ * NOTE: timer durations are measured with the kernel cycle counter, on the nrf52840 this is the
+ * 32kHz RTC, so durations have a resolution of ~30us.
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/conn.h>
+#include <bluetooth/services/nus.h>
+
+#include <string.h>
+#include <autoconf.h>
+
+#include "nus_cmd.h"
+#include "scheduler.h"
+
+// vendor specific endpoint of the perf read command, uses the Ruuvi message layout (nus_cmd.h)
+#define PERF_ENDPOINT     0xFA
+#define PERF_OP_READ      0x11
+#define PERF_OP_VALUE     0x10
+#define PERF_OP_BENCHMARK 0x20
+// length of the perf read command and of a single perf record
+#define PERF_MSG_LEN      11
+
+typedef enum {
+	PERF_ADV_CYCLES,
+	PERF_ADV_UPDATE_FAILURES,
+	PERF_ADV_START_FAILURES,
+	PERF_LED_WAKEUPS,
+	PERF_CONNECTIONS,
+	PERF_CONNECTION_FAILURES,
+	PERF_DISCONNECTIONS,
+	// DHT reads aborted because an edge arrived before the previous capture was copied
+	PERF_DHT_MISSED_EDGES,
+	// stop and start of advertising to switch the interval
+	PERF_ADV_RESTARTS,
+	// gateway role: valid RAWv2 advertisements, new samples forwarded, samples dropped
+	PERF_GATEWAY_RECEIVED,
+	PERF_GATEWAY_FORWARDED,
+	PERF_GATEWAY_DROPPED,
+	PERF_COUNTER_COUNT,
+} perf_counter_t;
+
+typedef enum {
+	PERF_TIMER_SENSOR_READ,
+	PERF_TIMER_ADV_UPDATE,
+	// stop and start of advertising, no events are sent in between
+	PERF_TIMER_ADV_RESTART,
+	// from the start of the last sensor read of a cycle until the payload has been published
+	PERF_TIMER_SAMPLE_TO_ADV,
+	// from resuming the LED PWM until it is suspended again, count x avg is its active time
+	PERF_TIMER_LED_ACTIVE,
+	// AES block of the advertisement encryption, precomputed after each publish
+	PERF_TIMER_KEYSTREAM,
+	// SAADC burst of the supply voltage, once per cycle
+	PERF_TIMER_BATTERY_READ,
+	// burst read of the accelerometer FIFO
+	PERF_TIMER_ACCEL_FIFO,
+	PERF_TIMER_COUNT,
+} perf_timer_t;
+
+#ifdef CONFIG_PERF_COUNTERS
+
+/**
+ * @brief increment the given counter, can be called from any context.
+ */
+void perf_inc(perf_counter_t counter);
+
+/**
+ * @brief start measuring a code section.
+ *
+ * @return start timestamp, to be passed to perf_timer_stop()
+ */
+static inline uint32_t perf_timer_start(void)
+{
+	return k_cycle_get_32();
+}
+
+/**
+ * @brief stop measuring a code section and add its duration to the given timer.
+ */
+void perf_timer_stop(perf_timer_t timer, uint32_t start);
+
+/**
+ * @brief send all counters, timers and thread statistics to the given connection.
+ *
+ * Each value is sent as an 11 byte record: endpoint, id, operation, two 32bit big endian values.
+ * The report is sent from the application work queue.
+ *
+ * @return 0 if the report was scheduled, -EBUSY if another report is pending
+ */
+int perf_request_report(struct bt_conn *conn);
+
+/**
+ * @brief send the given number of bytes to the given connection as fast as possible.
+ *
+ * The data is sent from the application work queue, followed by a record with the number of bytes
+ * sent and the duration of the transfer.
+ *
+ * @return 0 if the benchmark was scheduled, -EBUSY if another benchmark is running, -EINVAL if
+ * the number of bytes is invalid
+ */
+int perf_request_benchmark(struct bt_conn *conn, uint32_t bytes);
+
+#else
+
+static inline void perf_inc(perf_counter_t counter)
+{
+	ARG_UNUSED(counter);
+}
+
+static inline uint32_t perf_timer_start(void)
+{
+	return 0;
+}
+
+static inline void perf_timer_stop(perf_timer_t timer, uint32_t start)
+{
+	ARG_UNUSED(timer);
+	ARG_UNUSED(start);
+}
+
+static inline int perf_request_report(struct bt_conn *conn)
+{
+	ARG_UNUSED(conn);
+	return -ENOTSUP;
+}
+
+static inline int perf_request_benchmark(struct bt_conn *conn, uint32_t bytes)
+{
+	ARG_UNUSED(conn);
+	ARG_UNUSED(bytes);
+	return -ENOTSUP;
+}
+
+#endif // CONFIG_PERF_COUNTERS
+
+#endif // PERF_H
@@ -0,0 +1,103 @@
+#include "persist.h"
+
+LOG_MODULE_REGISTER(persist);
+
+// changed whenever the layout of the persisted values changes
+#define RETAINED_MAGIC  0x4D755631
+#define SEQUENCE_MODULO (RUUVI_RAWV2_SEQUENCE_MAX + 1)
+
+typedef struct {
+	uint32_t magic;
+	ruuvi_rawv2_t values;
+	uint32_t crc;
+} retained_t;
+
+typedef struct {
+	// last sequence number of the lease
+	uint16_t lease_end;
+	ruuvi_rawv2_t values;
+} stored_t;
+
+// not initialized on boot, keeps its content across resets
+static __noinit retained_t retained;
+
+// copy of the settings, only accessed from the application work queue (and init)
+static stored_t stored;
+static bool lease_valid;
+
+static uint32_t retained_crc(void)
+{
+	return crc32_ieee((const uint8_t *)&retained, offsetof(retained_t, crc));
+}
+
+static int load_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+		   void *param)
+{
+	if (len != sizeof(stored_t)) {
+		// written by a firmware with a different layout
+		return -EINVAL;
+	}
+	return read_cb(cb_arg, param, len) == len ? 0 : -EIO;
+}
+
+static void load_lease(void)
+{
+	stored_t value;
+
+	if (settings_subsys_init()) {
+		return;
+	}
+	value.lease_end = RUUVI_SEQUENCE_NA;
+	if (settings_load_subtree_direct(PERSIST_SETTINGS_KEY, load_cb, &value) ||
+	    value.lease_end == RUUVI_SEQUENCE_NA) {
+		return;
+	}
+	stored = value;
+	lease_valid = true;
+}
+
+int persist_load(ruuvi_rawv2_t *values, uint16_t *next_sequence_number)
+{
+	load_lease();
+
+	if (retained.magic == RETAINED_MAGIC && retained.crc == retained_crc()) {
+		*values = retained.values;
+		*next_sequence_number = values->sequence_number;
+		LOG_INF("continuing after sequence %u (retained)", *next_sequence_number);
+		return 0;
+	}
+	if (lease_valid) {
+		// the payload of the last flash write, anything before the end of the lease may
+		// have been advertised since with newer values, so it is restored with the last
+		// sequence number of the lease (reaching it writes a new lease)
+		*values = stored.values;
+		values->sequence_number = stored.lease_end;
+		*next_sequence_number = stored.lease_end;
+		LOG_INF("continuing after sequence %u (settings)", *next_sequence_number);
+		return 0;
+	}
+	return -ENOENT;
+}
+
+void persist_store(const ruuvi_rawv2_t *values)
+{
+	retained.magic = RETAINED_MAGIC;
+	retained.values = *values;
+	retained.crc = retained_crc();
+
+	// sequence numbers left in the lease, after a wrap from 65534 to 0 as well
+	uint16_t remaining = (stored.lease_end + SEQUENCE_MODULO - values->sequence_number) %
+			     SEQUENCE_MODULO;
+	if (lease_valid && remaining > 0 && remaining <= CONFIG_PERSIST_SEQUENCE_LEASE) {
+		return;
+	}
+	stored.lease_end =
+		(values->sequence_number + CONFIG_PERSIST_SEQUENCE_LEASE) % SEQUENCE_MODULO;
+	stored.values = *values;
+	int err = settings_save_one(PERSIST_SETTINGS_KEY, &stored, sizeof(stored));
+	if (err) {
+		// retried with the next publish
+		LOG_WRN("sequence lease could not be stored, err %d", err);
+	}
+	lease_valid = !err;
+}
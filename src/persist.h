@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief Sequence number and last payload values persisted across reboots.
+ *
+ * After every publish, the payload values (including the sequence number) are copied into a
+ * __noinit RAM block with a magic and a CRC32. This block survives resets and brown-outs as long as
+ * the RAM is powered and nothing (e.g. the bootloader) overwrites it, otherwise the CRC does not
+ * match.
+ *
+ * As a fallback, the settings (muuvi/seq) hold the last payload values together with the end of a
+ * sequence number lease: whenever the sequence number reaches the end of the lease, the next
+ * CONFIG_PERSIST_SEQUENCE_LEASE numbers are reserved with a single flash write. After a power loss,
+ * counting continues after the lease, so sequence numbers never go backwards, while the flash is
+ * only written every CONFIG_PERSIST_SEQUENCE_LEASE publishes.
+ */
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/crc.h>
+
+#include <stddef.h>
+#include <string.h>
+#include <autoconf.h>
+
+#include "ruuvi_codec.h"
+
+#define PERSIST_SETTINGS_KEY "muuvi/seq"
+
+#ifdef CONFIG_PERSIST_SEQUENCE
+
+/**
+ * @brief load the persisted payload values, from the retained RAM or the settings.
+ *
+ * @param values payload values of the last publish, with the sequence number they were advertised
+ * with (retained RAM) or the last one of the lease (settings)
+ * @param next_sequence_number last sequence number which may have been used, the next payload has
+ * to continue after it
+ *
+ * @return 0 on success, -ENOENT if nothing has been persisted yet
+ */
+int persist_load(ruuvi_rawv2_t *values, uint16_t *next_sequence_number);
+
+/**
+ * @brief persist the payload values of a publish.
+ *
+ * Writes to flash at the end of a sequence number lease. Must only be called from the application
+ * work queue.
+ */
+void persist_store(const ruuvi_rawv2_t *values);
+
+#else
+
+static inline int persist_load(ruuvi_rawv2_t *values, uint16_t *next_sequence_number)
+{
+	ARG_UNUSED(values);
+	ARG_UNUSED(next_sequence_number);
+	return -ENOENT;
+}
+
+static inline void persist_store(const ruuvi_rawv2_t *values)
+{
+	ARG_UNUSED(values);
+}
+
+#endif // CONFIG_PERSIST_SEQUENCE
+
+#endif // PERSIST_H
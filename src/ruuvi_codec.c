@@ -0,0 +1,383 @@
+#include "ruuvi_codec.h"
+
+#include <errno.h>
+#include <string.h>
+
+// payload offsets, relative to the start of the manufacturer data
+#define OFFSET_COMPANY_ID   0
+#define OFFSET_FORMAT       2
+#define OFFSET_TEMPERATURE  3
+#define OFFSET_HUMIDITY     5
+#define OFFSET_PRESSURE     7
+#define OFFSET_ACCELERATION 9
+#define OFFSET_POWER_INFO   15
+#define OFFSET_MOVEMENT     17
+#define OFFSET_SEQUENCE     18
+#define OFFSET_MAC          20
+
+// E1 payload offsets, relative to the start of the manufacturer data
+#define E1_OFFSET_TEMPERATURE 3
+#define E1_OFFSET_HUMIDITY    5
+#define E1_OFFSET_PRESSURE    7
+#define E1_OFFSET_PM          9
+#define E1_OFFSET_CO2         17
+#define E1_OFFSET_VOC         19
+#define E1_OFFSET_NOX         20
+#define E1_OFFSET_LUMINOSITY  21
+#define E1_OFFSET_RESERVED_1  24
+#define E1_OFFSET_SEQUENCE    27
+#define E1_OFFSET_FLAGS       30
+#define E1_OFFSET_RESERVED_2  31
+#define E1_OFFSET_MAC         36
+
+// format 8 payload offsets, relative to the start of the manufacturer data
+#define F8_OFFSET_COUNTER     3
+#define F8_OFFSET_TEMPERATURE 7
+#define F8_OFFSET_HUMIDITY    9
+#define F8_OFFSET_PRESSURE    11
+#define F8_OFFSET_POWER_INFO  13
+#define F8_OFFSET_MOVEMENT    15
+#define F8_OFFSET_SEQUENCE    16
+#define F8_OFFSET_RESERVED    18
+#define F8_OFFSET_CRC         19
+#define F8_OFFSET_MAC         20
+
+// CRC-8 (polynomial 0x07, initial value 0)
+#define CRC8_POLYNOMIAL       0x07
+
+// VOC and NOx are 9 bit values, the least significant bits are part of the flags
+#define E1_FLAG_VOC_LSB       0x40
+#define E1_FLAG_NOX_LSB       0x80
+
+// "not available" values of the encoded fields
+#define RAW_INT16_NA   0x8000
+#define RAW_UINT16_NA  0xFFFF
+#define RAW_UINT8_NA   0xFF
+#define RAW_BATTERY_NA 0x7FF
+#define RAW_TX_NA      0x1F
+#define RAW_INDEX_NA   0x1FF
+#define RAW_UINT24_NA  0xFFFFFF
+
+// power info: 11 bit battery voltage above 1.6V, 5 bit tx power above -40dBm in 2dBm steps
+#define POWER_INFO_TX_BITS 5
+#define POWER_INFO_TX_MASK 0x1F
+
+static inline void put_u16(uint8_t *buf, uint16_t value)
+{
+	// most significant byte first
+	buf[0] = (value >> 8) & 0xFF;
+	buf[1] = value & 0xFF;
+}
+
+static inline void put_u24(uint8_t *buf, uint32_t value)
+{
+	buf[0] = (value >> 16) & 0xFF;
+	buf[1] = (value >> 8) & 0xFF;
+	buf[2] = value & 0xFF;
+}
+
+static inline void put_u32(uint8_t *buf, uint32_t value)
+{
+	put_u16(buf, value >> 16);
+	put_u16(&buf[2], value & 0xFFFF);
+}
+
+static inline uint16_t get_u16(const uint8_t *buf)
+{
+	return ((uint16_t)buf[0] << 8) | buf[1];
+}
+
+static inline uint32_t get_u32(const uint8_t *buf)
+{
+	return ((uint32_t)get_u16(buf) << 16) | get_u16(&buf[2]);
+}
+
+static uint8_t crc8(const uint8_t *buf, size_t len)
+{
+	uint8_t crc = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		crc ^= buf[i];
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc & 0x80) ? (crc << 1) ^ CRC8_POLYNOMIAL : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static inline int32_t clamp(int32_t value, int32_t min, int32_t max)
+{
+	return value < min ? min : (value > max ? max : value);
+}
+
+static inline uint16_t encode_signed(int32_t value, int32_t max)
+{
+	if (value == INT32_MIN) {
+		return RAW_INT16_NA;
+	}
+	return (uint16_t)(int16_t)clamp(value, -max, max);
+}
+
+static inline int32_t decode_signed(uint16_t raw)
+{
+	return raw == RAW_INT16_NA ? INT32_MIN : (int16_t)raw;
+}
+
+static inline uint16_t encode_humidity(uint32_t humidity)
+{
+	if (humidity == RUUVI_HUMIDITY_NA) {
+		return RAW_UINT16_NA;
+	}
+	return humidity > RUUVI_RAWV2_HUMIDITY_MAX ? RUUVI_RAWV2_HUMIDITY_MAX : humidity;
+}
+
+static inline uint16_t encode_pressure(uint32_t pressure)
+{
+	if (pressure == RUUVI_PRESSURE_NA) {
+		return RAW_UINT16_NA;
+	}
+	pressure = pressure < RUUVI_RAWV2_PRESSURE_MIN ? RUUVI_RAWV2_PRESSURE_MIN : pressure;
+	pressure = pressure > RUUVI_RAWV2_PRESSURE_MAX ? RUUVI_RAWV2_PRESSURE_MAX : pressure;
+	return pressure - RUUVI_RAWV2_PRESSURE_MIN;
+}
+
+static inline uint32_t encode_unsigned(uint32_t value, uint32_t na, uint32_t max, uint32_t raw_na)
+{
+	if (value == na) {
+		return raw_na;
+	}
+	return value > max ? max : value;
+}
+
+static uint16_t encode_power_info(uint16_t battery_voltage, int8_t tx_power)
+{
+	uint16_t battery = RAW_BATTERY_NA;
+	uint16_t tx = RAW_TX_NA;
+
+	if (battery_voltage != RUUVI_BATTERY_NA) {
+		battery = clamp(battery_voltage, RUUVI_RAWV2_BATTERY_MIN, RUUVI_RAWV2_BATTERY_MAX) -
+			  RUUVI_RAWV2_BATTERY_MIN;
+	}
+	if (tx_power != RUUVI_TX_POWER_NA) {
+		tx = (clamp(tx_power, RUUVI_RAWV2_TX_POWER_MIN, RUUVI_RAWV2_TX_POWER_MAX) -
+		      RUUVI_RAWV2_TX_POWER_MIN) /
+		     2;
+	}
+	return (battery << POWER_INFO_TX_BITS) | tx;
+}
+
+void ruuvi_rawv2_init(ruuvi_rawv2_t *data)
+{
+	data->temperature = RUUVI_TEMPERATURE_NA;
+	data->humidity = RUUVI_HUMIDITY_NA;
+	data->pressure = RUUVI_PRESSURE_NA;
+	for (int i = 0; i < 3; i++) {
+		data->acceleration[i] = RUUVI_ACCELERATION_NA;
+	}
+	data->battery_voltage = RUUVI_BATTERY_NA;
+	data->tx_power = RUUVI_TX_POWER_NA;
+	data->movement_counter = RUUVI_MOVEMENT_NA;
+	data->sequence_number = RUUVI_SEQUENCE_NA;
+	memset(data->mac, 0, sizeof(data->mac));
+}
+
+int ruuvi_rawv2_encode(const ruuvi_rawv2_t *data, uint8_t *buf, size_t len)
+{
+	if (len < RUUVI_RAWV2_LEN) {
+		return -ENOBUFS;
+	}
+
+	// the company identifier is the only little endian field
+	buf[OFFSET_COMPANY_ID] = RUUVI_COMPANY_ID & 0xFF;
+	buf[OFFSET_COMPANY_ID + 1] = (RUUVI_COMPANY_ID >> 8) & 0xFF;
+	buf[OFFSET_FORMAT] = RUUVI_RAWV2_FORMAT;
+
+	put_u16(&buf[OFFSET_TEMPERATURE],
+		encode_signed(data->temperature, RUUVI_RAWV2_TEMPERATURE_MAX));
+
+	put_u16(&buf[OFFSET_HUMIDITY], encode_humidity(data->humidity));
+	put_u16(&buf[OFFSET_PRESSURE], encode_pressure(data->pressure));
+
+	for (int i = 0; i < 3; i++) {
+		put_u16(&buf[OFFSET_ACCELERATION + 2 * i],
+			encode_signed(data->acceleration[i], RUUVI_RAWV2_ACCEL_MAX));
+	}
+
+	put_u16(&buf[OFFSET_POWER_INFO],
+		encode_power_info(data->battery_voltage, data->tx_power));
+
+	// RUUVI_MOVEMENT_NA (255) is sent as "not available", counters have to wrap from 254 to 0
+	buf[OFFSET_MOVEMENT] = data->movement_counter;
+
+	put_u16(&buf[OFFSET_SEQUENCE], data->sequence_number);
+
+	memcpy(&buf[OFFSET_MAC], data->mac, RUUVI_MAC_LEN);
+
+	return RUUVI_RAWV2_LEN;
+}
+
+int ruuvi_rawv2_decode(const uint8_t *buf, size_t len, ruuvi_rawv2_t *data)
+{
+	if (len < RUUVI_RAWV2_LEN ||
+	    (buf[OFFSET_COMPANY_ID] | (buf[OFFSET_COMPANY_ID + 1] << 8)) != RUUVI_COMPANY_ID ||
+	    buf[OFFSET_FORMAT] != RUUVI_RAWV2_FORMAT) {
+		return -EINVAL;
+	}
+
+	data->temperature = decode_signed(get_u16(&buf[OFFSET_TEMPERATURE]));
+
+	uint16_t humidity = get_u16(&buf[OFFSET_HUMIDITY]);
+	data->humidity = humidity == RAW_UINT16_NA ? RUUVI_HUMIDITY_NA : humidity;
+
+	uint16_t pressure = get_u16(&buf[OFFSET_PRESSURE]);
+	data->pressure = pressure == RAW_UINT16_NA ? RUUVI_PRESSURE_NA
+						   : (uint32_t)pressure + RUUVI_RAWV2_PRESSURE_MIN;
+
+	for (int i = 0; i < 3; i++) {
+		data->acceleration[i] = decode_signed(get_u16(&buf[OFFSET_ACCELERATION + 2 * i]));
+	}
+
+	uint16_t power_info = get_u16(&buf[OFFSET_POWER_INFO]);
+	uint16_t battery = power_info >> POWER_INFO_TX_BITS;
+	uint8_t tx = power_info & POWER_INFO_TX_MASK;
+	data->battery_voltage =
+		battery == RAW_BATTERY_NA ? RUUVI_BATTERY_NA : battery + RUUVI_RAWV2_BATTERY_MIN;
+	data->tx_power = tx == RAW_TX_NA ? RUUVI_TX_POWER_NA : 2 * tx + RUUVI_RAWV2_TX_POWER_MIN;
+
+	data->movement_counter = buf[OFFSET_MOVEMENT];
+	data->sequence_number = get_u16(&buf[OFFSET_SEQUENCE]);
+
+	memcpy(data->mac, &buf[OFFSET_MAC], RUUVI_MAC_LEN);
+
+	return 0;
+}
+
+void ruuvi_e1_init(ruuvi_e1_t *data)
+{
+	data->temperature = RUUVI_TEMPERATURE_NA;
+	data->humidity = RUUVI_HUMIDITY_NA;
+	data->pressure = RUUVI_PRESSURE_NA;
+	for (int i = 0; i < 4; i++) {
+		data->pm[i] = RUUVI_PM_NA;
+	}
+	data->co2 = RUUVI_CO2_NA;
+	data->voc = RUUVI_VOC_NA;
+	data->nox = RUUVI_NOX_NA;
+	data->luminosity = RUUVI_LUMINOSITY_NA;
+	data->sequence_number = RUUVI_E1_SEQUENCE_NA;
+	data->flags = 0;
+	memset(data->mac, 0, sizeof(data->mac));
+}
+
+int ruuvi_e1_encode(const ruuvi_e1_t *data, uint8_t *buf, size_t len)
+{
+	if (len < RUUVI_E1_LEN) {
+		return -ENOBUFS;
+	}
+
+	buf[OFFSET_COMPANY_ID] = RUUVI_COMPANY_ID & 0xFF;
+	buf[OFFSET_COMPANY_ID + 1] = (RUUVI_COMPANY_ID >> 8) & 0xFF;
+	buf[OFFSET_FORMAT] = RUUVI_E1_FORMAT;
+
+	put_u16(&buf[E1_OFFSET_TEMPERATURE],
+		encode_signed(data->temperature, RUUVI_RAWV2_TEMPERATURE_MAX));
+	put_u16(&buf[E1_OFFSET_HUMIDITY], encode_humidity(data->humidity));
+	put_u16(&buf[E1_OFFSET_PRESSURE], encode_pressure(data->pressure));
+
+	for (int i = 0; i < 4; i++) {
+		put_u16(&buf[E1_OFFSET_PM + 2 * i],
+			encode_unsigned(data->pm[i], RUUVI_PM_NA, RUUVI_E1_PM_MAX, RAW_UINT16_NA));
+	}
+	put_u16(&buf[E1_OFFSET_CO2],
+		encode_unsigned(data->co2, RUUVI_CO2_NA, RUUVI_E1_CO2_MAX, RAW_UINT16_NA));
+
+	// upper 8 bits in their own bytes, the least significant bit in the flags
+	uint16_t voc = encode_unsigned(data->voc, RUUVI_VOC_NA, RUUVI_E1_VOC_MAX, RAW_INDEX_NA);
+	uint16_t nox = encode_unsigned(data->nox, RUUVI_NOX_NA, RUUVI_E1_NOX_MAX, RAW_INDEX_NA);
+	buf[E1_OFFSET_VOC] = voc >> 1;
+	buf[E1_OFFSET_NOX] = nox >> 1;
+
+	put_u24(&buf[E1_OFFSET_LUMINOSITY],
+		encode_unsigned(data->luminosity, RUUVI_LUMINOSITY_NA, RUUVI_E1_LUMINOSITY_MAX,
+				RAW_UINT24_NA));
+	memset(&buf[E1_OFFSET_RESERVED_1], 0xFF, E1_OFFSET_SEQUENCE - E1_OFFSET_RESERVED_1);
+
+	put_u24(&buf[E1_OFFSET_SEQUENCE],
+		encode_unsigned(data->sequence_number, RUUVI_E1_SEQUENCE_NA,
+				RUUVI_E1_SEQUENCE_MAX, RAW_UINT24_NA));
+
+	buf[E1_OFFSET_FLAGS] = (data->flags & RUUVI_E1_FLAG_CALIBRATION) |
+			       ((voc & 0x01) ? E1_FLAG_VOC_LSB : 0) |
+			       ((nox & 0x01) ? E1_FLAG_NOX_LSB : 0);
+	memset(&buf[E1_OFFSET_RESERVED_2], 0xFF, E1_OFFSET_MAC - E1_OFFSET_RESERVED_2);
+
+	memcpy(&buf[E1_OFFSET_MAC], data->mac, RUUVI_MAC_LEN);
+
+	return RUUVI_E1_LEN;
+}
+
+int ruuvi_f8_encode(const ruuvi_rawv2_t *data, uint32_t counter, uint8_t *buf, size_t len)
+{
+	if (len < RUUVI_F8_LEN) {
+		return -ENOBUFS;
+	}
+
+	buf[OFFSET_COMPANY_ID] = RUUVI_COMPANY_ID & 0xFF;
+	buf[OFFSET_COMPANY_ID + 1] = (RUUVI_COMPANY_ID >> 8) & 0xFF;
+	buf[OFFSET_FORMAT] = RUUVI_F8_FORMAT;
+	put_u32(&buf[F8_OFFSET_COUNTER], counter);
+
+	put_u16(&buf[F8_OFFSET_TEMPERATURE],
+		encode_signed(data->temperature, RUUVI_RAWV2_TEMPERATURE_MAX));
+	put_u16(&buf[F8_OFFSET_HUMIDITY], encode_humidity(data->humidity));
+	put_u16(&buf[F8_OFFSET_PRESSURE], encode_pressure(data->pressure));
+	put_u16(&buf[F8_OFFSET_POWER_INFO],
+		encode_power_info(data->battery_voltage, data->tx_power));
+	buf[F8_OFFSET_MOVEMENT] = data->movement_counter;
+	put_u16(&buf[F8_OFFSET_SEQUENCE], data->sequence_number);
+	buf[F8_OFFSET_RESERVED] = RAW_UINT8_NA;
+	buf[F8_OFFSET_CRC] = crc8(&buf[RUUVI_F8_CIPHER_OFFSET], F8_OFFSET_CRC - RUUVI_F8_CIPHER_OFFSET);
+
+	memcpy(&buf[F8_OFFSET_MAC], data->mac, RUUVI_MAC_LEN);
+
+	return RUUVI_F8_LEN;
+}
+
+int ruuvi_f8_decode(const uint8_t *buf, size_t len, ruuvi_rawv2_t *data, uint32_t *counter)
+{
+	if (len < RUUVI_F8_LEN ||
+	    (buf[OFFSET_COMPANY_ID] | (buf[OFFSET_COMPANY_ID + 1] << 8)) != RUUVI_COMPANY_ID ||
+	    buf[OFFSET_FORMAT] != RUUVI_F8_FORMAT) {
+		return -EINVAL;
+	}
+	if (crc8(&buf[RUUVI_F8_CIPHER_OFFSET], F8_OFFSET_CRC - RUUVI_F8_CIPHER_OFFSET) !=
+	    buf[F8_OFFSET_CRC]) {
+		return -EBADMSG;
+	}
+
+	ruuvi_rawv2_init(data);
+	*counter = get_u32(&buf[F8_OFFSET_COUNTER]);
+
+	data->temperature = decode_signed(get_u16(&buf[F8_OFFSET_TEMPERATURE]));
+
+	uint16_t humidity = get_u16(&buf[F8_OFFSET_HUMIDITY]);
+	data->humidity = humidity == RAW_UINT16_NA ? RUUVI_HUMIDITY_NA : humidity;
+
+	uint16_t pressure = get_u16(&buf[F8_OFFSET_PRESSURE]);
+	data->pressure = pressure == RAW_UINT16_NA ? RUUVI_PRESSURE_NA
+						   : (uint32_t)pressure + RUUVI_RAWV2_PRESSURE_MIN;
+
+	uint16_t power_info = get_u16(&buf[F8_OFFSET_POWER_INFO]);
+	uint16_t battery = power_info >> POWER_INFO_TX_BITS;
+	uint8_t tx = power_info & POWER_INFO_TX_MASK;
+	data->battery_voltage =
+		battery == RAW_BATTERY_NA ? RUUVI_BATTERY_NA : battery + RUUVI_RAWV2_BATTERY_MIN;
+	data->tx_power = tx == RAW_TX_NA ? RUUVI_TX_POWER_NA : 2 * tx + RUUVI_RAWV2_TX_POWER_MIN;
+
+	data->movement_counter = buf[F8_OFFSET_MOVEMENT];
+	data->sequence_number = get_u16(&buf[F8_OFFSET_SEQUENCE]);
+
+	memcpy(data->mac, &buf[F8_OFFSET_MAC], RUUVI_MAC_LEN);
+
+	return 0;
+}
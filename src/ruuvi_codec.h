@@ -0,0 +1,221 @@
+/**
+ * @file
+ * @brief Encoder and decoder for the Ruuvi advertisement payload formats.
+ *
+ * The codec only depends on the C standard library, it does not allocate and can be shared
+ * between the firmware and host side tools.
+ *
+ * Values are passed in the units of the payload format, but with wider types, so out of range
+ * values are clamped instead of silently wrapping around. Every field has a dedicated "not
+ * available" value (RUUVI_*_NA), which is encoded as the "not available" value of the format.
+ *
+ * Supported formats:
+ * - data format 5 (RAWv2), legacy advertising
+ *   https://docs.ruuvi.com/communication/bluetooth-advertisements/data-format-5-rawv2
+ * - data format E1 (extended v1), extended advertising only, encoder only
+ *   https://docs.ruuvi.com/communication/bluetooth-advertisements/data-format-e1
+ * - data format 8 style encrypted environmental payload, plaintext only (see ruuvi_f8_encode())
+ *   https://docs.ruuvi.com/communication/bluetooth-advertisements/data-format-8
+ */
+
+#ifndef RUUVI_CODEC_H
+#define RUUVI_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Company identifier (Ruuvi Innovations Ltd - 0x0499)
+#define RUUVI_COMPANY_ID    0x0499
+// Data format 5 (RAWv2)
+#define RUUVI_RAWV2_FORMAT  0x05
+// length of the RAWv2 manufacturer data, including the company identifier
+#define RUUVI_RAWV2_LEN     26
+// Data format E1 (extended v1)
+#define RUUVI_E1_FORMAT     0xE1
+// length of the E1 manufacturer data, including the company identifier
+#define RUUVI_E1_LEN        42
+// Data format 8 style (encrypted environmental)
+#define RUUVI_F8_FORMAT     0x08
+// length of the format 8 manufacturer data, including the company identifier
+#define RUUVI_F8_LEN        26
+#define RUUVI_MAC_LEN       6
+
+// encrypted part of the format 8 payload (measurements, reserved byte and CRC8), relative to the
+// start of the manufacturer data
+#define RUUVI_F8_CIPHER_OFFSET 7
+#define RUUVI_F8_CIPHER_LEN    13
+
+// "not available" values of the decoded fields
+#define RUUVI_TEMPERATURE_NA     INT32_MIN
+#define RUUVI_HUMIDITY_NA        UINT32_MAX
+#define RUUVI_PRESSURE_NA        UINT32_MAX
+#define RUUVI_ACCELERATION_NA    INT32_MIN
+#define RUUVI_BATTERY_NA         UINT16_MAX
+#define RUUVI_TX_POWER_NA        INT8_MIN
+#define RUUVI_MOVEMENT_NA        UINT8_MAX
+#define RUUVI_SEQUENCE_NA        UINT16_MAX
+#define RUUVI_PM_NA              UINT16_MAX
+#define RUUVI_CO2_NA             UINT16_MAX
+#define RUUVI_VOC_NA             UINT16_MAX
+#define RUUVI_NOX_NA             UINT16_MAX
+#define RUUVI_LUMINOSITY_NA      UINT32_MAX
+#define RUUVI_E1_SEQUENCE_NA     UINT32_MAX
+
+// valid ranges of the RAWv2 fields, values outside of them are clamped
+#define RUUVI_RAWV2_TEMPERATURE_MAX 32767   // 0.005 degree steps
+#define RUUVI_RAWV2_HUMIDITY_MAX    40000   // 0.0025% steps
+#define RUUVI_RAWV2_PRESSURE_MIN    50000   // Pa
+#define RUUVI_RAWV2_PRESSURE_MAX    115534  // Pa
+#define RUUVI_RAWV2_ACCEL_MAX       32767   // mG
+#define RUUVI_RAWV2_BATTERY_MIN     1600    // mV
+#define RUUVI_RAWV2_BATTERY_MAX     3646    // mV
+#define RUUVI_RAWV2_TX_POWER_MIN    (-40)   // dBm
+#define RUUVI_RAWV2_TX_POWER_MAX    20      // dBm
+#define RUUVI_RAWV2_SEQUENCE_MAX    65534
+
+// valid ranges of the E1 fields, values outside of them are clamped
+#define RUUVI_E1_PM_MAX             10000    // 0.1 ug/m3 steps
+#define RUUVI_E1_CO2_MAX            40000    // ppm
+#define RUUVI_E1_VOC_MAX            500      // index
+#define RUUVI_E1_NOX_MAX            500      // index
+#define RUUVI_E1_LUMINOSITY_MAX     14428400 // 0.01 lux steps
+#define RUUVI_E1_SEQUENCE_MAX       0xFFFFFE
+
+// E1 flags
+#define RUUVI_E1_FLAG_CALIBRATION   0x01
+
+typedef struct {
+	// temperature in 0.005 degree steps
+	int32_t temperature;
+	// humidity in 0.0025% steps
+	uint32_t humidity;
+	// atmospheric pressure in Pa (without the offset of the payload format)
+	uint32_t pressure;
+	// acceleration X, Y and Z in mG
+	int32_t acceleration[3];
+	// battery voltage in mV
+	uint16_t battery_voltage;
+	// tx power in dBm, encoded in 2dBm steps
+	int8_t tx_power;
+	// movement counter, incremented by motion detection interrupts from the accelerometer. Wraps
+	// from 254 to 0, 255 is RUUVI_MOVEMENT_NA.
+	uint8_t movement_counter;
+	// measurement sequence number, used for measurement de-duplication
+	uint16_t sequence_number;
+	// MAC address, most significant byte first
+	uint8_t mac[RUUVI_MAC_LEN];
+} ruuvi_rawv2_t;
+
+typedef struct {
+	// temperature in 0.005 degree steps
+	int32_t temperature;
+	// humidity in 0.0025% steps
+	uint32_t humidity;
+	// atmospheric pressure in Pa (without the offset of the payload format)
+	uint32_t pressure;
+	// particulate matter PM1.0, PM2.5, PM4.0 and PM10.0 in 0.1 ug/m3 steps
+	uint16_t pm[4];
+	// CO2 concentration in ppm
+	uint16_t co2;
+	// VOC and NOx index
+	uint16_t voc;
+	uint16_t nox;
+	// luminosity in 0.01 lux steps
+	uint32_t luminosity;
+	// measurement sequence number (24 bit), used for measurement de-duplication
+	uint32_t sequence_number;
+	// RUUVI_E1_FLAG_*
+	uint8_t flags;
+	// MAC address, most significant byte first
+	uint8_t mac[RUUVI_MAC_LEN];
+} ruuvi_e1_t;
+
+/**
+ * @brief set all fields of the given data to "not available".
+ */
+void ruuvi_rawv2_init(ruuvi_rawv2_t *data);
+
+/**
+ * @brief encode the given data as RAWv2 manufacturer data (including the company identifier).
+ *
+ * @param data values to encode, out of range values are clamped
+ * @param buf output buffer
+ * @param len length of the output buffer, at least RUUVI_RAWV2_LEN
+ *
+ * @return number of bytes written, -ENOBUFS if the buffer is too small
+ */
+int ruuvi_rawv2_encode(const ruuvi_rawv2_t *data, uint8_t *buf, size_t len);
+
+/**
+ * @brief decode RAWv2 manufacturer data (including the company identifier).
+ *
+ * @param buf manufacturer data
+ * @param len length of the manufacturer data
+ * @param data decoded values, "not available" fields are set to their RUUVI_*_NA value
+ *
+ * @return 0 on success, -EINVAL if the buffer does not contain a RAWv2 payload
+ */
+int ruuvi_rawv2_decode(const uint8_t *buf, size_t len, ruuvi_rawv2_t *data);
+
+/**
+ * @brief set all fields of the given data to "not available".
+ */
+void ruuvi_e1_init(ruuvi_e1_t *data);
+
+/**
+ * @brief encode the given data as E1 manufacturer data (including the company identifier).
+ *
+ * @param data values to encode, out of range values are clamped
+ * @param buf output buffer
+ * @param len length of the output buffer, at least RUUVI_E1_LEN
+ *
+ * @return number of bytes written, -ENOBUFS if the buffer is too small
+ */
+int ruuvi_e1_encode(const ruuvi_e1_t *data, uint8_t *buf, size_t len);
+
+/**
+ * @brief encode the given data as format 8 style manufacturer data, before encryption.
+ *
+ * | Offset | Content                                                                          |
+ * | ------ | -------------------------------------------------------------------------------- |
+ * | 0      | company identifier, format 8                                                     |
+ * | 3      | message counter (32bit), sent in clear, the nonce of the encryption              |
+ * | 7      | temperature, humidity, pressure, power info, movement counter, sequence number   |
+ * |        | (as RAWv2), reserved (0xFF) and a CRC8 of these 12 bytes                         |
+ * | 20     | MAC                                                                              |
+ *
+ * The caller encrypts RUUVI_F8_CIPHER_LEN bytes from RUUVI_F8_CIPHER_OFFSET in place. In
+ * contrast to the stock format 8 (AES-ECB of the whole block), the counter allows a stream
+ * cipher (AES-CTR), the payloads are not interoperable.
+ *
+ * @param data values to encode, the acceleration is not part of the format
+ * @param counter message counter, must never repeat for the same key
+ * @param buf output buffer
+ * @param len length of the output buffer, at least RUUVI_F8_LEN
+ *
+ * @return number of bytes written, -ENOBUFS if the buffer is too small
+ */
+int ruuvi_f8_encode(const ruuvi_rawv2_t *data, uint32_t counter, uint8_t *buf, size_t len);
+
+/**
+ * @brief decode format 8 style manufacturer data, after decryption.
+ *
+ * @param buf decrypted manufacturer data
+ * @param len length of the manufacturer data
+ * @param data decoded values, the acceleration is always "not available"
+ * @param counter message counter of the payload
+ *
+ * @return 0 on success, -EINVAL if the buffer does not contain a format 8 payload, -EBADMSG if
+ * the CRC does not match (e.g. decrypted with the wrong key)
+ */
+int ruuvi_f8_decode(const uint8_t *buf, size_t len, ruuvi_rawv2_t *data, uint32_t *counter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RUUVI_CODEC_H
@@ -0,0 +1,205 @@
+#include "scheduler.h"
+
+LOG_MODULE_REGISTER(scheduler);
+
+K_THREAD_STACK_DEFINE(app_work_q_stack, APP_WORK_Q_STACK_SIZE);
+struct k_work_q app_work_q;
+
+// latest (filtered) measurements, handed over from the sample to the encode stage
+static measurement_t measurements;
+// measurements of the last advertisement update
+static measurement_t published;
+static bool has_published = false;
+
+// reads of the current interval
+static int32_t temperature_samples[CONFIG_OVERSAMPLING_COUNT];
+static int32_t humidity_samples[CONFIG_OVERSAMPLING_COUNT];
+static size_t sample_count;
+static size_t sample_slot;
+// failed reads of the current slot, retried without blocking the queue
+static uint8_t read_retries;
+static filter_ema_t temperature_ema;
+static filter_ema_t humidity_ema;
+// start of the sensor read, which completed the current cycle
+static uint32_t cycle_start;
+
+static void sample_work_handler(struct k_work *work);
+static void encode_work_handler(struct k_work *work);
+static void publish_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(sample_work, sample_work_handler);
+static K_WORK_DEFINE(encode_work, encode_work_handler);
+static K_WORK_DEFINE(publish_work, publish_work_handler);
+
+static int32_t filter_samples(const int32_t *samples, filter_ema_t *ema)
+{
+	int32_t value = IS_ENABLED(CONFIG_FILTER_MEDIAN) ? filter_median(samples, sample_count)
+							 : filter_mean(samples, sample_count);
+	return filter_ema(ema, value, CONFIG_FILTER_EMA_SHIFT);
+}
+
+static bool changed_significantly(void)
+{
+	if (!has_published) {
+		return true;
+	}
+	// every movement is advertised, so gateways can track the asset
+	return abs(measurements.temperature - published.temperature) >
+		       CONFIG_CHANGE_THRESHOLD_TEMPERATURE ||
+	       abs(measurements.humidity - published.humidity) > CONFIG_CHANGE_THRESHOLD_HUMIDITY ||
+	       measurements.movement_counter != published.movement_counter;
+}
+
+// random delay in [-CONFIG_MEASUREMENT_JITTER_MS / 2, CONFIG_MEASUREMENT_JITTER_MS / 2] ms
+static int32_t interval_jitter_ms(void)
+{
+#ifdef CONFIG_MEASUREMENT_JITTER
+	return (int32_t)(sys_rand32_get() % (CONFIG_MEASUREMENT_JITTER_MS + 1)) -
+	       CONFIG_MEASUREMENT_JITTER_MS / 2;
+#else
+	return 0;
+#endif
+}
+
+// supply voltage, sampled once per cycle. Without a VDD channel, the dongle is USB powered.
+static uint16_t sample_battery_voltage(void)
+{
+	uint16_t voltage_mv;
+
+	if (!IS_ENABLED(CONFIG_BATTERY_VOLTAGE)) {
+		return BATTERY_VOLTAGE_USB_MV;
+	}
+	return read_battery_voltage(&voltage_mv) ? MEASUREMENT_BATTERY_NA : voltage_mv;
+}
+
+// time between two sensor reads
+static int32_t sample_interval_ms(void)
+{
+	return params_get(PARAM_MEASUREMENT_INTERVAL_SEC) * 1000 / CONFIG_OVERSAMPLING_COUNT;
+}
+
+// sample stage: read the sensors CONFIG_OVERSAMPLING_COUNT times per interval, then filter the
+// reads and only continue with the encode stage, if the measurements have changed
+static void sample_work_handler(struct k_work *work)
+{
+	measurement_t sample;
+
+	// schedule the next read first, so the interval does not drift by the time spent here. The
+	// jitter is only applied once per cycle, the reads of a cycle are evenly spaced. It never
+	// shortens the time to the next read below the minimum of the sensor.
+	int32_t delay_ms = sample_interval_ms();
+	if (sample_slot + 1 == CONFIG_OVERSAMPLING_COUNT) {
+		delay_ms = MAX(delay_ms + interval_jitter_ms(), sensor_min_interval_ms());
+	}
+	k_work_schedule_for_queue(&app_work_q, &sample_work, K_MSEC(delay_ms));
+
+	LOG_DBG("collecting measurements...");
+	set_led_pattern(&PATTERN_COLLECTING_SENSOR);
+	TRACE_POINT("sample", sample_slot, CONFIG_OVERSAMPLING_COUNT);
+	uint32_t sampled_ms = k_uptime_get_32();
+	uint32_t start = perf_timer_start();
+	int err = read_sensor_values(&sample);
+	perf_timer_stop(PERF_TIMER_SENSOR_READ, start);
+	if (err && read_retries < CONFIG_SENSOR_READ_RETRIES) {
+		// read the same slot again once the sensor allows it, the rest of the cycle is
+		// delayed by the retries
+		read_retries++;
+		LOG_WRN("retrying sensor read %u of %d", read_retries, CONFIG_SENSOR_READ_RETRIES);
+		k_work_reschedule_for_queue(&app_work_q, &sample_work,
+					    K_MSEC(sensor_min_interval_ms()));
+		return;
+	}
+	read_retries = 0;
+	if (!err) {
+		temperature_samples[sample_count] = sample.temperature;
+		humidity_samples[sample_count] = sample.humidity;
+		sample_count++;
+	}
+	if (++sample_slot < CONFIG_OVERSAMPLING_COUNT) {
+		return;
+	}
+	sample_slot = 0;
+	if (sample_count == 0) {
+		// keep advertising the last valid measurements. The EMA history is stale after a
+		// whole interval of failed reads, the next valid reads start a new average.
+		filter_ema_reset(&temperature_ema);
+		filter_ema_reset(&humidity_ema);
+		return;
+	}
+
+	measurements.temperature = filter_samples(temperature_samples, &temperature_ema);
+	measurements.humidity = filter_samples(humidity_samples, &humidity_ema);
+	measurements.battery_voltage = sample_battery_voltage();
+	read_motion_values(&measurements);
+	measurements.sampled_ms = sampled_ms;
+	sample_count = 0;
+
+	if (!changed_significantly()) {
+		LOG_DBG("measurements unchanged, skipping advertisement update");
+		if (IS_ENABLED(CONFIG_HISTORY)) {
+			history_log(&measurements);
+		}
+		return;
+	}
+	published = measurements;
+	has_published = true;
+	cycle_start = start;
+
+	k_work_submit_to_queue(&app_work_q, &encode_work);
+}
+
+// encode stage: write the measurements into the advertisement payload
+static void encode_work_handler(struct k_work *work)
+{
+	update_advertisement_data(&measurements);
+
+	k_work_submit_to_queue(&app_work_q, &publish_work);
+}
+
+// publish stage: pass the new payload to the controller
+static void publish_work_handler(struct k_work *work)
+{
+	if (publish_advertisement_data()) {
+		set_led_pattern(&PATTERN_BLE_ADVERTISING_FAILED);
+	} else {
+		perf_timer_stop(PERF_TIMER_SAMPLE_TO_ADV, cycle_start);
+		set_led_pattern(&PATTERN_BLE_ADVERTISING);
+	}
+
+	// flash writes are done after publishing, so they do not delay the advertisement
+	if (IS_ENABLED(CONFIG_HISTORY)) {
+		history_log(&measurements);
+	}
+}
+
+int get_latest_measurements(measurement_t *latest)
+{
+	if (!has_published) {
+		return -ENODATA;
+	}
+	*latest = published;
+	return 0;
+}
+
+void init_scheduler(void)
+{
+	k_work_queue_init(&app_work_q);
+	k_work_queue_start(&app_work_q, app_work_q_stack, K_THREAD_STACK_SIZEOF(app_work_q_stack),
+			   APP_WORK_Q_PRIORITY, NULL);
+	k_thread_name_set(&app_work_q.thread, "app_work_q");
+
+	// the gateway only uses the work queue, it does not measure anything
+	if (!IS_ENABLED(CONFIG_ROLE_SENSOR)) {
+		return;
+	}
+
+	LOG_INF("starting measurement cycle every %d seconds (%d reads)...",
+		params_get(PARAM_MEASUREMENT_INTERVAL_SEC), CONFIG_OVERSAMPLING_COUNT);
+	// nodes powered up at the same time start at a random phase, so they do not advertise their
+	// updates at the same time
+	k_timeout_t first = K_NO_WAIT;
+	if (IS_ENABLED(CONFIG_MEASUREMENT_JITTER)) {
+		first = K_MSEC(sys_rand32_get() % sample_interval_ms());
+	}
+	k_work_schedule_for_queue(&app_work_q, &sample_work, first);
+}
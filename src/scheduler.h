@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief Event driven measurement scheduler.
+ *
+ * A measurement cycle is split into three stages, each running as its own work item on the
+ * application work queue:
+ *
+ * | Stage   | Description                                                 |
+ * | ------- | ----------------------------------------------------------- |
+ * | sample  | reads the sensor values, reschedules itself every interval  |
+ * | encode  | writes the measurements into the advertisement payload      |
+ * | publish | hands the updated payload over to the BLE controller        |
+ *
+ * The sample stage reads the sensors CONFIG_OVERSAMPLING_COUNT times per interval. At the end of
+ * the interval, the reads are filtered (median or mean, followed by an optional EMA across
+ * intervals), the encode and publish stages only run if the filtered measurements differ from the
+ * advertised ones by more than CONFIG_CHANGE_THRESHOLD_*. This keeps the sequence number (and the
+ * number of records gateways have to store) constant while nothing changes.
+ *
+ * The measurement interval is a runtime parameter (params.h), a new interval is used from the next
+ * sensor read on.
+ *
+ * Between two cycles no thread is runnable, so the CPU stays idle until the next sample is due.
+ * Other modules (e.g. NUS handling) can submit their own work to the application work queue,
+ * which is then interleaved with the measurement stages.
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/random/random.h>
+
+#include <stdlib.h>
+#include <autoconf.h>
+
+#include "ble.h"
+#include "filter.h"
+#include "history.h"
+#include "led.h"
+#include "params.h"
+#include "perf.h"
+#include "sensors.h"
+
+#define APP_WORK_Q_STACK_SIZE CONFIG_APP_WORK_Q_STACK_SIZE
+#define APP_WORK_Q_PRIORITY   K_PRIO_PREEMPT(7)
+
+/**
+ * @brief work queue used for all application work (measurements, NUS handling, ...).
+ *
+ * Unlike the system work queue, work items on this queue are allowed to block on the BLE stack.
+ */
+extern struct k_work_q app_work_q;
+
+/**
+ * @brief get the measurements of the last advertisement update.
+ *
+ * Must only be called from the application work queue.
+ *
+ * @return 0 on success, -ENODATA if no measurements have been advertised yet
+ */
+int get_latest_measurements(measurement_t *latest);
+
+/**
+ * @brief start the application work queue and schedule the first measurement immediately.
+ *
+ * Returns right away, all further measurements are driven by the scheduler itself. In the gateway
+ * role, only the work queue is started.
+ */
+void init_scheduler(void);
+
+#endif // SCHEDULER_H
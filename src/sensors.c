@@ -2,7 +2,34 @@
 
 LOG_MODULE_REGISTER(sensors);
 
-void read_sensor_values(measurement_t *measurements)
+#ifdef CONFIG_SENSOR_BACKEND_DHT
+
+static int read_backend(measurement_t *measurements)
+{
+	dht_values_t values;
+	int err = dht_read(&values);
+	if (err) {
+		return err;
+	}
+	// the DHT reports 0.1 degree and 0.1% steps
+	measurements->temperature = values.temperature * 20;
+	measurements->humidity = values.humidity * 40;
+	return 0;
+}
+
+static int init_backend(void)
+{
+	return dht_init();
+}
+
+int sensor_min_interval_ms(void)
+{
+	return dht_min_interval_ms();
+}
+
+#else
+
+static int read_backend(measurement_t *measurements)
 {
 	LOG_INF("generating random measurement values...");
 	// generate a random humidity value (0 to 40000, mapped to 0% to 100% in 0.0025
@@ -10,10 +37,81 @@ void read_sensor_values(measurement_t *measurements)
 	measurements->humidity = sys_rand32_get() % 40001;
 	// generate a random temperature value (-32767 to 32767, mapped to -163.835 to +163.835
 	// degrees in 0.005 increments)
-	measurements->temperature = (sys_rand32_get() % 65536) - 32768;
+	measurements->temperature = (sys_rand32_get() % 65535) - 32767;
+	return 0;
+}
+
+static int init_backend(void)
+{
+	return 0;
+}
+
+int sensor_min_interval_ms(void)
+{
+	return 0;
 }
 
-void init_sensors()
+#endif // CONFIG_SENSOR_BACKEND_DHT
+
+int read_sensor_values(measurement_t *measurements)
 {
-	// todo: once sensors are connected, init them accordingly
-}
\ No newline at end of file
+	int err = read_backend(measurements);
+
+	if (err) {
+		LOG_WRN("sensor read failed, err %d", err);
+		measurements->temperature = MEASUREMENT_TEMPERATURE_NA;
+		measurements->humidity = MEASUREMENT_HUMIDITY_NA;
+	}
+	return err;
+}
+
+#ifdef CONFIG_ACCEL_LIS2DH12
+
+void read_motion_values(measurement_t *measurements)
+{
+	uint32_t movements;
+
+	if (lis2dh12_take(measurements->acceleration, &movements)) {
+		for (int axis = 0; axis < 3; axis++) {
+			measurements->acceleration[axis] = MEASUREMENT_ACCELERATION_NA;
+		}
+	}
+	// the movement counter wraps before its "not available" value
+	measurements->movement_counter =
+		LIS2DH12_HAS_MOTION ? movements % MEASUREMENT_MOVEMENT_NA : MEASUREMENT_MOVEMENT_NA;
+}
+
+static int init_motion(void)
+{
+	return lis2dh12_init();
+}
+
+#else
+
+void read_motion_values(measurement_t *measurements)
+{
+	for (int axis = 0; axis < 3; axis++) {
+		measurements->acceleration[axis] = MEASUREMENT_ACCELERATION_NA;
+	}
+	measurements->movement_counter = MEASUREMENT_MOVEMENT_NA;
+}
+
+static int init_motion(void)
+{
+	return 0;
+}
+
+#endif // CONFIG_ACCEL_LIS2DH12
+
+int init_sensors(void)
+{
+	int err = init_backend();
+	if (err) {
+		LOG_ERR("sensor init failed, err %d", err);
+	}
+	int motion_err = init_motion();
+	if (motion_err) {
+		LOG_ERR("accelerometer init failed, err %d", motion_err);
+	}
+	return err ? err : motion_err;
+}
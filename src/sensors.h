@@ -1,16 +1,69 @@
 #ifndef SENSORS_H
 #define SENSORS_H
 
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/random/random.h>
 
+#include <autoconf.h>
+
+#ifdef CONFIG_SENSOR_BACKEND_DHT
+#include "dht.h"
+#endif
+#ifdef CONFIG_ACCEL_LIS2DH12
+#include "lis2dh12.h"
+#endif
+
+// "not available" values of the measurements
+#define MEASUREMENT_TEMPERATURE_NA  INT16_MIN
+#define MEASUREMENT_HUMIDITY_NA     UINT16_MAX
+#define MEASUREMENT_BATTERY_NA      0
+#define MEASUREMENT_ACCELERATION_NA INT16_MIN
+#define MEASUREMENT_MOVEMENT_NA     UINT8_MAX
+
 typedef struct {
+	// temperature in 0.005 degree steps
 	int16_t temperature;
+	// humidity in 0.0025% steps
 	uint16_t humidity;
+	// supply voltage in mV, sampled once per cycle (not by read_sensor_values())
+	uint16_t battery_voltage;
+	// average acceleration of the X, Y and Z axis over the cycle in mG (read_motion_values())
+	int16_t acceleration[3];
+	// number of movements, wraps from 254 to 0 (read_motion_values())
+	uint8_t movement_counter;
+	// uptime of the sensor read which completed the cycle in ms, for the sample-to-air latency
+	uint32_t sampled_ms;
 } measurement_t;
 
-void init_sensors(void);
+/**
+ * @brief init the configured sensor backend (CONFIG_SENSOR_BACKEND_*).
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int init_sensors(void);
+
+/**
+ * @brief read the current sensor values.
+ *
+ * If the read fails, the measurements are set to their "not available" values. It is not retried
+ * here, the scheduler retries it after sensor_min_interval_ms() (CONFIG_SENSOR_READ_RETRIES).
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int read_sensor_values(measurement_t *measurements);
+
+/**
+ * @brief minimum time between two reads of the sensor backend in ms, 0 if it has none.
+ */
+int sensor_min_interval_ms(void);
 
-void read_sensor_values(measurement_t *measurements);
+/**
+ * @brief read the average acceleration and the movement counter of the current cycle.
+ *
+ * Without an accelerometer, or if no samples have been collected, the values are set to their
+ * "not available" values. Must only be called from the application work queue, once per cycle.
+ */
+void read_motion_values(measurement_t *measurements);
 
-#endif // SENSORS_H
\ No newline at end of file
+#endif // SENSORS_H
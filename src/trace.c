@@ -0,0 +1,57 @@
+#include "trace.h"
+
+LOG_MODULE_REGISTER(trace);
+
+// the controller triggers this EGU task through PPI at the start of each advertising event. EGU0,
+// EGU1 and EGU5 are left to the radio drivers and MPSL.
+#define TRACE_EGU          NRF_EGU2
+#define TRACE_EGU_IRQn     SWI2_EGU2_IRQn
+#define TRACE_EGU_PRIORITY 4
+
+// sequence number of the payload awaiting its first advertising event, -1 if none
+static atomic_t armed_sequence = ATOMIC_INIT(-1);
+
+static void egu_isr(const void *arg)
+{
+	nrf_egu_event_clear(TRACE_EGU, NRF_EGU_EVENT_TRIGGERED0);
+
+	atomic_val_t sequence = atomic_set(&armed_sequence, -1);
+	if (sequence >= 0) {
+		TRACE_POINT("adv_event", sequence, 0);
+	}
+}
+
+void trace_adv_payload(uint16_t sequence_number)
+{
+	atomic_set(&armed_sequence, sequence_number);
+}
+
+int trace_adv_events_enable(uint8_t handle)
+{
+	static bool egu_ready;
+	sdc_hci_cmd_vs_set_event_start_task_t *params;
+	struct net_buf *buf;
+
+	if (!egu_ready) {
+		IRQ_CONNECT(TRACE_EGU_IRQn, TRACE_EGU_PRIORITY, egu_isr, NULL, 0);
+		nrf_egu_int_enable(TRACE_EGU, NRF_EGU_INT_TRIGGERED0);
+		irq_enable(TRACE_EGU_IRQn);
+		egu_ready = true;
+	}
+
+	buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_SET_EVENT_START_TASK, sizeof(*params));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	params = net_buf_add(buf, sizeof(*params));
+	params->handle_type = SDC_HCI_VS_SET_EVENT_START_TASK_HANDLE_TYPE_ADV;
+	params->handle = sys_cpu_to_le16(handle);
+	params->task_address =
+		sys_cpu_to_le32(nrf_egu_task_address_get(TRACE_EGU, NRF_EGU_TASK_TRIGGER0));
+
+	int err = bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_SET_EVENT_START_TASK, buf, NULL);
+	if (err) {
+		LOG_WRN("advertising events can not be traced, err %d", err);
+	}
+	return err;
+}
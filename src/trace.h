@@ -0,0 +1,82 @@
+/**
+ * @file
+ * @brief Named trace points of the measurement pipeline.
+ *
+ * With CONFIG_TRACING_CTF (tracing.conf), the pipeline emits CTF named events next to the kernel
+ * events (ISRs, thread switches, work items) of Zephyr's tracing subsystem:
+ *
+ * - sample (slot, reads per cycle): a sensor read starts
+ * - encode (sequence, buffer): the measurements have been written into the inactive payload
+ * - adv_update / adv_start (sequence, err): the payload has been passed to the controller
+ * - swap (sequence, buffer): the new payload is the active one
+ * - adv_event (sequence): first advertising event after the swap (CONFIG_TRACE_ADV_EVENTS)
+ * - connected (err) / disconnected (reason), led (pattern step)
+ *
+ * scripts/trace_latency.py reports the latency distributions between these points. Without
+ * tracing, the trace points compile to nothing.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/irq.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/tracing/tracing.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/hci.h>
+
+#include <autoconf.h>
+
+#ifdef CONFIG_TRACE_ADV_EVENTS
+#include <sdc_hci_vs.h>
+#include <hal/nrf_egu.h>
+#endif
+
+#ifdef CONFIG_TRACING_CTF
+// name is truncated to 20 characters by the CTF format
+#define TRACE_POINT(_name, _arg0, _arg1) sys_trace_named_event(_name, _arg0, _arg1)
+#else
+#define TRACE_POINT(_name, _arg0, _arg1)                                                           \
+	do {                                                                                       \
+		ARG_UNUSED(_arg0);                                                                 \
+		ARG_UNUSED(_arg1);                                                                 \
+	} while (0)
+#endif // CONFIG_TRACING_CTF
+
+#ifdef CONFIG_TRACE_ADV_EVENTS
+
+/**
+ * @brief let the controller signal the start of each event of the given advertising set.
+ *
+ * Must be called after the set has been started, from a thread which may block on HCI commands.
+ *
+ * @param handle HCI advertising handle, 0 for legacy advertising
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int trace_adv_events_enable(uint8_t handle);
+
+/**
+ * @brief emit an adv_event trace point with the given sequence number at the next advertising
+ * event.
+ */
+void trace_adv_payload(uint16_t sequence_number);
+
+#else
+
+static inline int trace_adv_events_enable(uint8_t handle)
+{
+	ARG_UNUSED(handle);
+	return -ENOTSUP;
+}
+
+static inline void trace_adv_payload(uint16_t sequence_number)
+{
+	ARG_UNUSED(sequence_number);
+}
+
+#endif // CONFIG_TRACE_ADV_EVENTS
+
+#endif // TRACE_H
@@ -0,0 +1,102 @@
+#include "tx_power.h"
+
+LOG_MODULE_REGISTER(tx_power);
+
+#define TX_POWER_MAX_DBM CONFIG_BT_CTLR_TX_PWR_DBM
+
+BUILD_ASSERT(CONFIG_TX_POWER_MIN_DBM <= TX_POWER_MAX_DBM,
+	     "the minimum TX power must not exceed the default one");
+
+// last ack: sequence number, RSSI and a valid flag, written by the BT RX thread
+#define ACK_VALID      BIT(24)
+#define ACK_SEQ_MASK   0xFFFF
+#define ACK_RSSI_SHIFT 16
+
+static atomic_t last_ack = ATOMIC_INIT(0);
+
+// only accessed from the application work queue
+static int8_t max_level = TX_POWER_MAX_DBM;
+static int8_t level = TX_POWER_MAX_DBM;
+static uint8_t confirmed;
+
+int tx_power_ack(uint32_t sequence_number, int32_t rssi)
+{
+	if (sequence_number > ACK_SEQ_MASK || rssi < INT8_MIN || rssi > INT8_MAX) {
+		return -EINVAL;
+	}
+	atomic_set(&last_ack, ACK_VALID | ((uint8_t)rssi << ACK_RSSI_SHIFT) | sequence_number);
+	return 0;
+}
+
+int8_t tx_power_next(uint16_t sequence_number)
+{
+	atomic_val_t ack = atomic_clear(&last_ack);
+
+	if (level > max_level) {
+		// the maximum has been lowered
+		level = max_level;
+		confirmed = 0;
+		return level;
+	}
+	if (!(ack & ACK_VALID) || (ack & ACK_SEQ_MASK) != sequence_number) {
+		// not confirmed (in time), back up one step
+		confirmed = 0;
+		if (level < max_level) {
+			level = MIN(level + CONFIG_TX_POWER_STEP_DB, max_level);
+			LOG_INF("sequence %u not confirmed, raising TX power to %ddBm",
+				sequence_number, level);
+		}
+		return level;
+	}
+
+	int8_t rssi = (int8_t)(ack >> ACK_RSSI_SHIFT);
+	if (++confirmed < CONFIG_TX_POWER_ACKS) {
+		return level;
+	}
+	confirmed = 0;
+	if (level > CONFIG_TX_POWER_MIN_DBM &&
+	    rssi - CONFIG_TX_POWER_STEP_DB >= CONFIG_TX_POWER_RSSI_MIN) {
+		level = MAX(level - CONFIG_TX_POWER_STEP_DB, CONFIG_TX_POWER_MIN_DBM);
+		LOG_INF("received with %ddBm, lowering TX power to %ddBm", rssi, level);
+	}
+	return level;
+}
+
+void tx_power_set_max(int8_t max_dbm)
+{
+	max_level = CLAMP(max_dbm, CONFIG_TX_POWER_MIN_DBM, TX_POWER_MAX_DBM);
+}
+
+void tx_power_applied(int8_t selected)
+{
+	if (selected != level) {
+		LOG_INF("TX power %ddBm requested, %ddBm in use", level, selected);
+		level = selected;
+	}
+}
+
+int tx_power_set_adv(uint8_t handle, int8_t level, int8_t *selected)
+{
+	struct bt_hci_cp_vs_write_tx_power_level *cp;
+	struct bt_hci_rp_vs_write_tx_power_level *rp;
+	struct net_buf *buf, *rsp = NULL;
+
+	buf = bt_hci_cmd_create(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, sizeof(*cp));
+	if (!buf) {
+		return -ENOBUFS;
+	}
+	cp = net_buf_add(buf, sizeof(*cp));
+	cp->handle_type = BT_HCI_VS_LL_HANDLE_TYPE_ADV;
+	cp->handle = sys_cpu_to_le16(handle);
+	cp->tx_power_level = level;
+
+	int err = bt_hci_cmd_send_sync(BT_HCI_OP_VS_WRITE_TX_POWER_LEVEL, buf, &rsp);
+	if (err) {
+		LOG_WRN("TX power could not be set, err %d", err);
+		return err;
+	}
+	rp = (void *)rsp->data;
+	*selected = rp->selected_tx_power;
+	net_buf_unref(rsp);
+	return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file
+ * @brief Adaptive TX power of the advertisements.
+ *
+ * Gateways confirm the reception of a payload with the TX power ack command over NUS
+ * (FC FC 13 <sequence number> <rssi>, two 32bit big endian values), the RSSI being the one the
+ * gateway measured for the advertisement. With every new payload, the level is:
+ *
+ * - lowered by CONFIG_TX_POWER_STEP_DB after CONFIG_TX_POWER_ACKS confirmed payloads in a row,
+ *   if the RSSI would still be above CONFIG_TX_POWER_RSSI_MIN
+ * - raised by one step, if the previous payload has not been confirmed
+ *
+ * so without gateways acknowledging, the node stays at (or returns to) its maximum level,
+ * CONFIG_BT_CTLR_TX_PWR_DBM or the tx power runtime parameter (params.h).
+ * The level is set per advertising set with the Zephyr vendor specific HCI command, the TX power
+ * of the power info field and of the scan response are always the level selected by the
+ * controller.
+ */
+
+#ifndef TX_POWER_H
+#define TX_POWER_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/buf.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/hci_vs.h>
+
+#include <autoconf.h>
+
+// vendor specific endpoint of the TX power ack, uses the Ruuvi message layout (nus_cmd.h)
+#define TX_POWER_ENDPOINT 0xFC
+#define TX_POWER_OP_ACK   0x13
+
+#ifdef CONFIG_TX_POWER_ADAPTIVE
+
+/**
+ * @brief confirm the reception of a payload, called from the NUS RX callback.
+ *
+ * @return 0 on success, -EINVAL if the sequence number or RSSI is out of range
+ */
+int tx_power_ack(uint32_t sequence_number, int32_t rssi);
+
+/**
+ * @brief level of the next payload, depending on whether the current one has been confirmed.
+ *
+ * Must only be called from the application work queue, once per new payload.
+ *
+ * @param sequence_number sequence number of the currently advertised payload
+ */
+int8_t tx_power_next(uint16_t sequence_number);
+
+/**
+ * @brief limit the level of the following payloads, the current level is lowered with the next
+ * one if needed.
+ *
+ * Must only be called from the application work queue (or before BLE is initialized).
+ *
+ * @param max_dbm maximum level in dBm, clamped to CONFIG_TX_POWER_MIN_DBM and
+ * CONFIG_BT_CTLR_TX_PWR_DBM
+ */
+void tx_power_set_max(int8_t max_dbm);
+
+/**
+ * @brief report the level in use after applying the one of tx_power_next(), the next step starts
+ * from it.
+ *
+ * Must only be called from the application work queue.
+ *
+ * @param selected level the controller has selected, or the previous one if it could not be set
+ */
+void tx_power_applied(int8_t selected);
+
+/**
+ * @brief set the TX power of an advertising set.
+ *
+ * @param handle HCI advertising handle, 0 for legacy advertising
+ * @param level requested level in dBm
+ * @param selected level the controller has selected (the closest supported one) in dBm
+ *
+ * @return 0 on success, negative error code otherwise
+ */
+int tx_power_set_adv(uint8_t handle, int8_t level, int8_t *selected);
+
+#else
+
+static inline int tx_power_ack(uint32_t sequence_number, int32_t rssi)
+{
+	ARG_UNUSED(sequence_number);
+	ARG_UNUSED(rssi);
+	return -ENOTSUP;
+}
+
+static inline int8_t tx_power_next(uint16_t sequence_number)
+{
+	ARG_UNUSED(sequence_number);
+	return CONFIG_BT_CTLR_TX_PWR_DBM;
+}
+
+static inline void tx_power_set_max(int8_t max_dbm)
+{
+	ARG_UNUSED(max_dbm);
+}
+
+static inline void tx_power_applied(int8_t selected)
+{
+	ARG_UNUSED(selected);
+}
+
+static inline int tx_power_set_adv(uint8_t handle, int8_t level, int8_t *selected)
+{
+	ARG_UNUSED(handle);
+	ARG_UNUSED(level);
+	ARG_UNUSED(selected);
+	return -ENOTSUP;
+}
+
+#endif // CONFIG_TX_POWER_ADAPTIVE
+
+#endif // TX_POWER_H
@@ -3,21 +3,20 @@
 
 #include <zephyr/bluetooth/bluetooth.h>
 
-/** @brief Converts binary LE Bluetooth address to string. in comparison to the zephyr variant, this
- * does not append the address tpye in brackets (because it's irrelevant)...
+/** @brief printf format of a binary LE Bluetooth address, most significant byte first. In
+ * comparison to the zephyr variant, the address type is not appended (because it's irrelevant)...
  *
- *  @param addr Address of buffer containing binary LE Bluetooth address.
- *  @param str Address of user buffer with enough room to store
- *  formatted string containing binary LE address.
- *  @param len Length of data to be copied to user string buffer. Refer to
- *  BT_ADDR_LE_STR_LEN about recommended value.
+ * Use together with ADDR_ARGS() in log messages, so the address is only formatted if the message
+ * is actually printed (or on the host, with dictionary logging) and never in the caller.
+ */
+#define ADDR_FMT "%02X:%02X:%02X:%02X:%02X:%02X"
+
+/** @brief arguments for ADDR_FMT.
  *
- *  @return Number of successfully formatted bytes from binary address.
+ *  @param _addr Address of the binary LE Bluetooth address (bt_addr_le_t).
  */
-static inline int bt_addr_le_to_str_without_type(const bt_addr_le_t *addr, char *str, size_t len)
-{
-	return snprintk(str, len, "%02X:%02X:%02X:%02X:%02X:%02X", addr->a.val[5], addr->a.val[4],
-			addr->a.val[3], addr->a.val[2], addr->a.val[1], addr->a.val[0]);
-}
+#define ADDR_ARGS(_addr)                                                                           \
+	(_addr)->a.val[5], (_addr)->a.val[4], (_addr)->a.val[3], (_addr)->a.val[2],                \
+		(_addr)->a.val[1], (_addr)->a.val[0]
 
-#endif // UTILS_H
\ No newline at end of file
+#endif // UTILS_H
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+# Builds the firmware (end to end and fleet profiles) and the scanner for nrf52_bsim and installs
+# them next to the BabbleSim phy, in ${BSIM_OUT_PATH}/bin. Arguments are added to the cmake
+# arguments of the firmware, e.g. -DCONFIG_MEASUREMENT_JITTER=n.
+set -eu
+
+: "${BSIM_OUT_PATH:?has to point to the BabbleSim output directory}"
+script_dir=$(cd "$(dirname "$0")" && pwd)
+app_root=$(cd "${script_dir}/../.." && pwd)
+build_root=${BUILD_ROOT:-${app_root}/build/bsim}
+
+# <name> <app dir> [cmake arguments]
+build() {
+	local name=$1 app=$2
+	shift 2
+	west build -b nrf52_bsim --no-sysbuild -d "${build_root}/${name}" "${app}" -- "$@"
+	cp "${build_root}/${name}/zephyr/zephyr.exe" "${BSIM_OUT_PATH}/bin/bs_nrf52_bsim_${name}"
+}
+
+build muuvi "${app_root}" -DEXTRA_CONF_FILE="${script_dir}/muuvi.conf" "$@"
+build muuvi_fleet "${app_root}" -DEXTRA_CONF_FILE="${script_dir}/fleet.conf" "$@"
+build muuvi_scanner "${script_dir}/scanner"
@@ -0,0 +1,22 @@
+#!/usr/bin/env bash
+# End to end test: one muuvi node next to the scanner in BabbleSim. Fails if an update is lost or
+# received with the wrong values, or if the latency or advertising gaps exceed the thresholds.
+# Build the images with compile.sh first, arguments are passed on to report.py.
+set -eu
+
+: "${BSIM_OUT_PATH:?has to point to the BabbleSim output directory}"
+script_dir=$(cd "$(dirname "$0")" && pwd)
+simulation_id=${SIMULATION_ID:-muuvi_e2e}
+sim_length_s=${SIM_LENGTH_S:-120}
+results=${RESULTS_DIR:-${script_dir}/results/${simulation_id}}
+
+mkdir -p "${results}"
+cd "${BSIM_OUT_PATH}/bin"
+./bs_2G4_phy_v1 -s="${simulation_id}" -D=2 -sim_length=$((sim_length_s * 1000000)) \
+	>"${results}/phy.log" 2>&1 &
+./bs_nrf52_bsim_muuvi -s="${simulation_id}" -d=0 -rs=1 >"${results}/node_0.log" 2>&1 &
+./bs_nrf52_bsim_muuvi_scanner -s="${simulation_id}" -d=1 -rs=1000 >"${results}/scanner.log" 2>&1 &
+wait
+
+python3 "${script_dir}/report.py" --scanner "${results}/scanner.log" \
+	--out "${results}/report.txt" "$@" "${results}/node_0.log"
@@ -0,0 +1,34 @@
+#!/usr/bin/env bash
+# Fleet density scenario: N muuvi nodes (default 50) in range of one scanner in BabbleSim. Reports
+# the packet reception ratio, the ratio of received updates and the latency per node, and fails
+# below the thresholds. Build the images with compile.sh first, to compare jitter settings pass
+# e.g. -DCONFIG_MEASUREMENT_JITTER=n to it.
+#
+# Usage: fleet.sh [nodes] [report.py arguments]
+set -eu
+
+: "${BSIM_OUT_PATH:?has to point to the BabbleSim output directory}"
+script_dir=$(cd "$(dirname "$0")" && pwd)
+nodes=${1:-50}
+[ $# -gt 0 ] && shift
+simulation_id=${SIMULATION_ID:-muuvi_fleet_${nodes}}
+sim_length_s=${SIM_LENGTH_S:-300}
+results=${RESULTS_DIR:-${script_dir}/results/${simulation_id}}
+
+mkdir -p "${results}"
+rm -f "${results}"/node_*.log
+cd "${BSIM_OUT_PATH}/bin"
+./bs_2G4_phy_v1 -s="${simulation_id}" -D=$((nodes + 1)) -sim_length=$((sim_length_s * 1000000)) \
+	>"${results}/phy.log" 2>&1 &
+for ((i = 0; i < nodes; i++)); do
+	./bs_nrf52_bsim_muuvi_fleet -s="${simulation_id}" -d=${i} -rs=$((i + 1)) \
+		>"${results}/node_${i}.log" 2>&1 &
+done
+./bs_nrf52_bsim_muuvi_scanner -s="${simulation_id}" -d=${nodes} -rs=1000 \
+	>"${results}/scanner.log" 2>&1 &
+wait
+
+# each update is advertised ~30 times, a few lost packets must not lose it
+python3 "${script_dir}/report.py" --scanner "${results}/scanner.log" --prr --min-prr 0.7 \
+	--max-latency-ms 5000 --max-gap-ms 10000 --settle-ms 10000 \
+	--out "${results}/report.txt" "$@" "${results}"/node_*.log
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+"""Latency, advertising gap and payload report of a BabbleSim run of muuvi nodes and the scanner.
+
+The nodes log each encoded payload with its sequence number, the uptime of its sensor read and its
+values ("updated advertising values: ..."), and each publish with the log timestamp ("advertising
+sequence ..."). The scanner (tests/bsim/scanner) prints every received RAWv2 advertisement with
+its uptime. All devices of a simulation boot together, so both share the same time base.
+
+For every node and update, the report matches the first reception of the sequence number against
+the log of the node:
+
+- sample -> air: from the sensor read to the first reception
+- publish -> air: from passing the payload to the controller to the first reception, this includes
+  the advertising restart when switching to the fast interval
+- gap: time between two receptions of a node, the largest ones are the restarts
+- payload: every reception of a sequence carries the logged values, no unknown sequence numbers
+
+Updates published less than --settle-ms before the end of the scan are not expected to be received
+yet. The script fails if an update is lost, a payload is wrong, or a threshold is exceeded.
+
+With --prr, the packet reception ratio of each node is the number of received advertising events
+over the number of events sent between its first and last reception. The advertising period
+(interval plus the mean advDelay) is estimated from the shortest gaps between receptions, so it
+requires a constant advertising interval (fleet.conf).
+
+Usage: report.py --scanner <scanner log> <node log>... [--max-latency-ms MS] [--max-gap-ms MS]
+                 [--min-update-ratio RATIO] [--prr] [--min-prr RATIO] [--out FILE]
+"""
+
+import argparse
+import re
+import sys
+
+# shortest advertising interval, closer receptions are copies of the same event on another channel
+MIN_ADV_INTERVAL_MS = 20
+
+NODE_ADDRESS = re.compile(r"visible as '.*' with address '([0-9A-F:]{17})'")
+NODE_UPDATE = re.compile(r"updated advertising values: sequence (\d+), sampled at (\d+) ms, "
+                         r"temperature: (-?)(\d+)\.(\d+), humidity: (\d+)\.(\d+)")
+NODE_PUBLISH = re.compile(r"\[(\d+):(\d+):(\d+)\.(\d+),(\d+)\] <inf> ble: advertising sequence "
+                          r"(\d+)")
+SCANNER_RX = re.compile(r"rx ([0-9A-F:]{17}) (\d+) (\d+) (-?\d+) (\d+) (-?\d+)")
+
+
+class Node:
+    def __init__(self, log):
+        self.log = log
+        self.mac = None
+        # sequence number -> {sampled, published, temperature, humidity}, in ms and 0.01 steps
+        self.updates = {}
+        # (time in ms, sequence number, temperature, humidity) as received by the scanner
+        self.receptions = []
+
+
+def parse_node(log):
+    node = Node(log)
+    with open(log, errors="replace") as f:
+        for line in f:
+            if m := NODE_ADDRESS.search(line):
+                node.mac = m.group(1)
+            elif m := NODE_UPDATE.search(line):
+                sign = -1 if m.group(3) else 1
+                node.updates[int(m.group(1))] = {
+                    "sampled": int(m.group(2)),
+                    "temperature": sign * (int(m.group(4)) * 100 + int(m.group(5))),
+                    "humidity": int(m.group(6)) * 100 + int(m.group(7)),
+                }
+            elif m := NODE_PUBLISH.search(line):
+                h, mi, s, ms, us = (int(g) for g in m.groups()[:5])
+                update = node.updates.get(int(m.group(6)))
+                if update is not None:
+                    update["published"] = ((h * 60 + mi) * 60 + s) * 1000 + ms + us / 1000
+    if node.mac is None:
+        sys.exit(f"{log}: no address found, is it the log of a muuvi node?")
+    return node
+
+
+def parse_scanner(log, nodes):
+    by_mac = {node.mac: node for node in nodes}
+    end_ms = 0
+    with open(log, errors="replace") as f:
+        for line in f:
+            m = SCANNER_RX.search(line)
+            if not m:
+                continue
+            t_ms = int(m.group(2)) / 1000
+            end_ms = max(end_ms, t_ms)
+            node = by_mac.get(m.group(1))
+            if node is not None:
+                node.receptions.append((t_ms, int(m.group(3)), int(m.group(4)),
+                                        int(m.group(5))))
+    return end_ms
+
+
+def expected_values(temperature, humidity):
+    # the node logs the measurements in 0.01 steps, truncated like the C division
+    centi = abs(temperature) // 2
+    return (-centi if temperature < 0 else centi), humidity // 4
+
+
+def packet_reception_ratio(gaps, events):
+    # gaps up to 1.5 times the shortest one are between consecutive events
+    single = [g for g in gaps if g < 1.5 * min(gaps)]
+    period = sum(single) / len(single)
+    return events / (round(sum(gaps) / period) + 1)
+
+
+def analyze(node, end_ms, settle_ms):
+    result = {"sample": [], "publish": [], "gaps": [], "bad": set(), "unknown": set(),
+              "expected": 0, "received": 0, "lost": [], "events": 0, "prr": None}
+    first_rx = {}
+    last_t = None
+    for t_ms, seq, temperature, humidity in sorted(node.receptions):
+        if last_t is None or t_ms - last_t >= MIN_ADV_INTERVAL_MS:
+            if last_t is not None:
+                result["gaps"].append(t_ms - last_t)
+            last_t = t_ms
+            result["events"] += 1
+        update = node.updates.get(seq)
+        if update is None:
+            result["unknown"].add(seq)
+            continue
+        if expected_values(temperature, humidity) != (update["temperature"],
+                                                      update["humidity"]):
+            result["bad"].add(seq)
+        first_rx.setdefault(seq, t_ms)
+
+    for seq, update in node.updates.items():
+        published = update.get("published", update["sampled"])
+        if published > end_ms - settle_ms:
+            continue
+        result["expected"] += 1
+        if seq not in first_rx:
+            result["lost"].append(seq)
+            continue
+        result["received"] += 1
+        result["sample"].append(first_rx[seq] - update["sampled"])
+        if "published" in update:
+            result["publish"].append(first_rx[seq] - update["published"])
+    if result["gaps"]:
+        result["prr"] = packet_reception_ratio(result["gaps"], result["events"])
+    return result
+
+
+def percentile(values, p):
+    # nearest rank
+    return values[max(0, -(-len(values) * p // 100) - 1)]
+
+
+def distribution(label, values):
+    values = sorted(values)
+    if not values:
+        return f"{label:<22}{'-':>9}"
+    return (f"{label:<22}{values[0]:>9.1f}" +
+            "".join(f"{percentile(values, p):>9.1f}" for p in (50, 95, 99)) +
+            f"{values[-1]:>9.1f}")
+
+
+def report(nodes, results, prr):
+    lines = [f"{'node':<19}{'updates':>9}{'received':>9}{'lost':>6}{'bad':>6}"
+             f"{'p50 ms':>9}{'max ms':>9}{'max gap':>9}" + (f"{'prr':>7}" if prr else "")]
+    for node, r in zip(nodes, results):
+        latency = sorted(r["sample"])
+        lines.append(f"{node.mac:<19}{r['expected']:>9}{r['received']:>9}{len(r['lost']):>6}"
+                     f"{len(r['bad']) + len(r['unknown']):>6}" +
+                     (f"{percentile(latency, 50):>9.1f}{latency[-1]:>9.1f}" if latency
+                      else f"{'-':>9}{'-':>9}") +
+                     (f"{max(r['gaps']):>9.1f}" if r["gaps"] else f"{'-':>9}") +
+                     ((f"{r['prr']:>7.3f}" if r["prr"] is not None else f"{'-':>7}")
+                      if prr else ""))
+    lines += ["", f"{'all nodes [ms]':<22}{'min':>9}{'p50':>9}{'p95':>9}{'p99':>9}{'max':>9}"]
+    for key, label in (("sample", "sample -> air"), ("publish", "publish -> air"),
+                       ("gaps", "gap")):
+        lines.append(distribution(label, [v for r in results for v in r[key]]))
+    expected = sum(r["expected"] for r in results)
+    received = sum(r["received"] for r in results)
+    lines += ["", f"{len(nodes)} nodes, {received} of {expected} updates received"]
+    if prr:
+        ratios = sorted(r["prr"] for r in results if r["prr"] is not None)
+        if ratios:
+            lines.append(f"packet reception ratio: min {ratios[0]:.3f}, "
+                         f"p50 {percentile(ratios, 50):.3f}, max {ratios[-1]:.3f}")
+    return lines
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("nodes", nargs="+", help="logs of the muuvi nodes")
+    parser.add_argument("--scanner", required=True, help="log of the scanner")
+    parser.add_argument("--max-latency-ms", type=float, default=250,
+                        help="fail if an update takes longer from sample to air")
+    parser.add_argument("--max-gap-ms", type=float, default=2500,
+                        help="fail if a node is not received for longer")
+    parser.add_argument("--min-update-ratio", type=float, default=1.0,
+                        help="fail if a node has a smaller ratio of received updates")
+    parser.add_argument("--prr", action="store_true",
+                        help="report the packet reception ratio, needs a constant interval")
+    parser.add_argument("--min-prr", type=float, default=0,
+                        help="fail if a node has a smaller packet reception ratio")
+    parser.add_argument("--settle-ms", type=float, default=3000,
+                        help="updates published this close to the end are not expected")
+    parser.add_argument("--out", help="also write the report to this file")
+    args = parser.parse_args()
+
+    nodes = [parse_node(log) for log in args.nodes]
+    macs = [node.mac for node in nodes]
+    if len(set(macs)) != len(macs):
+        sys.exit("nodes with the same address can not be told apart")
+    end_ms = parse_scanner(args.scanner, nodes)
+    if end_ms == 0:
+        sys.exit("no RAWv2 advertisements in the scanner log")
+    results = [analyze(node, end_ms, args.settle_ms) for node in nodes]
+
+    lines = report(nodes, results, args.prr)
+    failures = []
+    for node, r in zip(nodes, results):
+        ratio = r["received"] / r["expected"] if r["expected"] else 0
+        if ratio < args.min_update_ratio:
+            failures.append(f"{node.mac}: {r['received']} of {r['expected']} updates received, "
+                            f"lost {r['lost'][:10]}")
+        if r["bad"]:
+            failures.append(f"{node.mac}: wrong payload of sequences {sorted(r['bad'])[:10]}")
+        if r["unknown"]:
+            failures.append(f"{node.mac}: unknown sequences {sorted(r['unknown'])[:10]}")
+        slow = [v for v in r["sample"] if v > args.max_latency_ms]
+        if slow:
+            failures.append(f"{node.mac}: {len(slow)} updates exceed {args.max_latency_ms}ms "
+                            f"from sample to air, max {max(slow):.1f}ms")
+        if args.prr and (r["prr"] is None or r["prr"] < args.min_prr):
+            failures.append(f"{node.mac}: packet reception ratio "
+                            f"{r['prr'] if r['prr'] is not None else 0:.3f} below "
+                            f"{args.min_prr}")
+        gaps = [v for v in r["gaps"] if v > args.max_gap_ms]
+        if gaps:
+            failures.append(f"{node.mac}: {len(gaps)} gaps exceed {args.max_gap_ms}ms, "
+                            f"max {max(gaps):.1f}ms")
+    lines.append("")
+    lines += failures if failures else ["all nodes within the thresholds"]
+
+    report_text = "\n".join(lines) + "\n"
+    sys.stdout.write(report_text)
+    if args.out:
+        with open(args.out, "w") as f:
+            f.write(report_text)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
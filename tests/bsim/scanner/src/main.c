@@ -0,0 +1,72 @@
+/*
+ * BabbleSim scanner of the muuvi tests: scans continuously and prints one line per received RAWv2
+ * advertisement, which tests/bsim/report.py matches against the logs of the nodes:
+ *
+ * rx <MAC of the payload> <uptime in us> <sequence> <temperature> <humidity> <rssi>
+ *
+ * All simulated devices boot at the same time, so the uptime of the scanner and of the nodes share
+ * the same time base.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gap.h>
+#include <zephyr/sys/printk.h>
+
+#include "ruuvi_codec.h"
+
+// 100% duty cycle, every advertising event is received on one of its channels
+static const struct bt_le_scan_param scan_param = {
+	.type = BT_LE_SCAN_TYPE_PASSIVE,
+	.options = BT_LE_SCAN_OPT_NONE,
+	.interval = BT_GAP_SCAN_FAST_INTERVAL,
+	.window = BT_GAP_SCAN_FAST_INTERVAL,
+};
+
+typedef struct {
+	ruuvi_rawv2_t values;
+	bool found;
+} rawv2_result_t;
+
+static bool parse_ad(struct bt_data *data, void *user_data)
+{
+	rawv2_result_t *result = user_data;
+
+	if (data->type != BT_DATA_MANUFACTURER_DATA) {
+		return true;
+	}
+	result->found = !ruuvi_rawv2_decode(data->data, data->data_len, &result->values);
+	return !result->found;
+}
+
+static void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t adv_type,
+		    struct net_buf_simple *ad)
+{
+	rawv2_result_t result = {.found = false};
+	uint64_t now_us = k_ticks_to_us_floor64(k_uptime_ticks());
+
+	bt_data_parse(ad, parse_ad, &result);
+	if (!result.found) {
+		return;
+	}
+	const uint8_t *mac = result.values.mac;
+	printk("rx %02X:%02X:%02X:%02X:%02X:%02X %llu %u %d %u %d\n", mac[0], mac[1], mac[2],
+	       mac[3], mac[4], mac[5], now_us, result.values.sequence_number,
+	       result.values.temperature, result.values.humidity, rssi);
+}
+
+int main(void)
+{
+	int err = bt_enable(NULL);
+	if (err) {
+		printk("bluetooth init failed, err %d\n", err);
+		return err;
+	}
+	err = bt_le_scan_start(&scan_param, scan_cb);
+	if (err) {
+		printk("scanning could not be started, err %d\n", err);
+		return err;
+	}
+	printk("scanning\n");
+	return 0;
+}
@@ -0,0 +1,127 @@
+#include <zephyr/ztest.h>
+
+#include "filter.h"
+
+ZTEST(filter, test_median_odd)
+{
+	static const int32_t values[] = {5, 1, 4, 2, 3};
+
+	zassert_equal(filter_median(values, ARRAY_SIZE(values)), 3);
+	zassert_equal(filter_median(values, 1), 5);
+}
+
+ZTEST(filter, test_median_even)
+{
+	// the lower one of the two middle values
+	static const int32_t values[] = {40, 10, 30, 20};
+
+	zassert_equal(filter_median(values, ARRAY_SIZE(values)), 20);
+	zassert_equal(filter_median(values, 2), 10);
+}
+
+ZTEST(filter, test_median_outlier)
+{
+	// a single spike is dropped, the input is not modified
+	int32_t values[] = {2210, 2205, -9999, 2215, 2200};
+
+	zassert_equal(filter_median(values, ARRAY_SIZE(values)), 2205);
+	zassert_equal(values[2], -9999);
+}
+
+ZTEST(filter, test_median_negative_and_duplicates)
+{
+	static const int32_t values[] = {-3, -3, 7, -8, -3, 7};
+
+	zassert_equal(filter_median(values, ARRAY_SIZE(values)), -3);
+}
+
+ZTEST(filter, test_median_max_count)
+{
+	int32_t values[FILTER_MEDIAN_MAX_COUNT + 2];
+
+	for (size_t i = 0; i < ARRAY_SIZE(values); i++) {
+		values[i] = FILTER_MEDIAN_MAX_COUNT - i;
+	}
+	// values beyond FILTER_MEDIAN_MAX_COUNT are ignored
+	zassert_equal(filter_median(values, ARRAY_SIZE(values)), FILTER_MEDIAN_MAX_COUNT / 2 + 1);
+}
+
+ZTEST(filter, test_mean)
+{
+	static const int32_t values[] = {1, 2, 4};
+	static const int32_t negative[] = {-1, -2, -4};
+	static const int32_t large[] = {INT32_MAX, INT32_MAX, INT32_MAX};
+
+	// rounded towards zero
+	zassert_equal(filter_mean(values, ARRAY_SIZE(values)), 2);
+	zassert_equal(filter_mean(negative, ARRAY_SIZE(negative)), -2);
+	// the sum does not overflow
+	zassert_equal(filter_mean(large, ARRAY_SIZE(large)), INT32_MAX);
+}
+
+ZTEST(filter, test_ema_first_value)
+{
+	filter_ema_t ema = {0};
+
+	zassert_equal(filter_ema(&ema, 2345, 2), 2345);
+	zassert_true(ema.initialized);
+	zassert_equal(ema.state, 2345 << FILTER_EMA_FRACTION_BITS);
+}
+
+ZTEST(filter, test_ema_step)
+{
+	filter_ema_t ema = {0};
+
+	filter_ema(&ema, 0, 2);
+	// a quarter of the step per value: 25, 43.75, 57.8125
+	zassert_equal(filter_ema(&ema, 100, 2), 25);
+	zassert_equal(filter_ema(&ema, 100, 2), 44);
+	zassert_equal(filter_ema(&ema, 100, 2), 58);
+
+	// converges to the input within the rounding of the fixed point state
+	for (int i = 0; i < 100; i++) {
+		filter_ema(&ema, 100, 2);
+	}
+	zassert_within(filter_ema(&ema, 100, 2), 100, 1);
+}
+
+ZTEST(filter, test_ema_rounding)
+{
+	filter_ema_t ema = {0};
+
+	// 0.5 rounds away from zero for both signs
+	filter_ema(&ema, 0, 1);
+	zassert_equal(filter_ema(&ema, 1, 1), 1);
+	filter_ema_reset(&ema);
+	filter_ema(&ema, 0, 1);
+	zassert_equal(filter_ema(&ema, -1, 1), -1);
+
+	// -25 -> -37.5 -> -43.75
+	filter_ema_reset(&ema);
+	filter_ema(&ema, -25, 1);
+	zassert_equal(filter_ema(&ema, -50, 1), -38);
+	zassert_equal(filter_ema(&ema, -50, 1), -44);
+}
+
+ZTEST(filter, test_ema_disabled)
+{
+	filter_ema_t ema = {0};
+
+	filter_ema(&ema, 100, 0);
+	zassert_equal(filter_ema(&ema, -7, 0), -7);
+	zassert_equal(filter_ema(&ema, 3000, 0), 3000);
+}
+
+ZTEST(filter, test_ema_reset)
+{
+	filter_ema_t ema = {0};
+
+	filter_ema(&ema, 1000, 3);
+	filter_ema(&ema, 2000, 3);
+	filter_ema_reset(&ema);
+	zassert_false(ema.initialized);
+	// the next value initializes the filter again, without the old history
+	zassert_equal(filter_ema(&ema, -500, 3), -500);
+}
+
+ZTEST_SUITE(filter, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,12 @@
+// runs in the native simulator runner, outside of the simulated kernel
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t bench_host_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,82 @@
+#include <zephyr/ztest.h>
+
+#include "ruuvi_codec.h"
+
+#define ITERATIONS CONFIG_RUUVI_CODEC_BENCHMARK_ITERATIONS
+
+// host/bench_clock.c
+extern uint64_t bench_host_time_ns(void);
+
+static volatile int sink;
+
+static ruuvi_rawv2_t values(uint32_t i)
+{
+	ruuvi_rawv2_t data = {
+		.temperature = 4860 + (int32_t)(i & 0xFF),
+		.humidity = 21396,
+		.pressure = 100044,
+		.acceleration = {4, -4, 1036},
+		.battery_voltage = 3300,
+		.tx_power = 0,
+		.movement_counter = 66,
+		.sequence_number = i % (RUUVI_RAWV2_SEQUENCE_MAX + 1),
+		.mac = {0xCB, 0xB8, 0x33, 0x4C, 0x88, 0x4F},
+	};
+	return data;
+}
+
+ZTEST(ruuvi_codec_benchmark, test_rawv2_encode)
+{
+	ruuvi_rawv2_t data = values(0);
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	uint64_t start = bench_host_time_ns();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		data.sequence_number = i;
+		sink = ruuvi_rawv2_encode(&data, buf, sizeof(buf));
+	}
+	uint64_t elapsed = bench_host_time_ns() - start;
+
+	zassert_equal(sink, RUUVI_RAWV2_LEN);
+	TC_PRINT("rawv2 encode: %u iterations, %llu ns/call\n", ITERATIONS,
+		 (unsigned long long)(elapsed / ITERATIONS));
+}
+
+ZTEST(ruuvi_codec_benchmark, test_rawv2_decode)
+{
+	ruuvi_rawv2_t data = values(0);
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	ruuvi_rawv2_encode(&data, buf, sizeof(buf));
+
+	uint64_t start = bench_host_time_ns();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		buf[RUUVI_RAWV2_LEN - 1] = i;
+		sink = ruuvi_rawv2_decode(buf, sizeof(buf), &data);
+	}
+	uint64_t elapsed = bench_host_time_ns() - start;
+
+	zassert_equal(sink, 0);
+	TC_PRINT("rawv2 decode: %u iterations, %llu ns/call\n", ITERATIONS,
+		 (unsigned long long)(elapsed / ITERATIONS));
+}
+
+ZTEST(ruuvi_codec_benchmark, test_f8_round_trip)
+{
+	ruuvi_rawv2_t data = values(0);
+	uint8_t buf[RUUVI_F8_LEN];
+	uint32_t counter;
+
+	uint64_t start = bench_host_time_ns();
+	for (uint32_t i = 0; i < ITERATIONS; i++) {
+		ruuvi_f8_encode(&data, i, buf, sizeof(buf));
+		sink = ruuvi_f8_decode(buf, sizeof(buf), &data, &counter);
+	}
+	uint64_t elapsed = bench_host_time_ns() - start;
+
+	zassert_equal(sink, 0);
+	TC_PRINT("f8 encode + decode: %u iterations, %llu ns/call\n", ITERATIONS,
+		 (unsigned long long)(elapsed / ITERATIONS));
+}
+
+ZTEST_SUITE(ruuvi_codec_benchmark, NULL, NULL, NULL, NULL, NULL);
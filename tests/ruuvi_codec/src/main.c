@@ -0,0 +1,290 @@
+#include <zephyr/ztest.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "ruuvi_codec.h"
+
+// offsets of the RAWv2 manufacturer data, including the company identifier
+#define OFFSET_TEMPERATURE  3
+#define OFFSET_HUMIDITY     5
+#define OFFSET_PRESSURE     7
+#define OFFSET_ACCELERATION 9
+#define OFFSET_POWER_INFO   15
+
+static const uint8_t mac[RUUVI_MAC_LEN] = {0xCB, 0xB8, 0x33, 0x4C, 0x88, 0x4F};
+
+// test vectors of the format documentation, preceded by the company identifier
+// https://docs.ruuvi.com/communication/bluetooth-advertisements/data-format-5-rawv2
+static const uint8_t valid_vector[RUUVI_RAWV2_LEN] = {
+	0x99, 0x04, 0x05, 0x12, 0xFC, 0x53, 0x94, 0xC3, 0x7C, 0x00, 0x04, 0xFF, 0xFC, 0x04, 0x0C,
+	0xAC, 0x36, 0x42, 0x00, 0xCD, 0xCB, 0xB8, 0x33, 0x4C, 0x88, 0x4F,
+};
+static const uint8_t min_vector[RUUVI_RAWV2_LEN] = {
+	0x99, 0x04, 0x05, 0x80, 0x01, 0x00, 0x00, 0x00, 0x00, 0x80, 0x01, 0x80, 0x01, 0x80, 0x01,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0xCB, 0xB8, 0x33, 0x4C, 0x88, 0x4F,
+};
+// all fields "not available", the MAC is the one of the data
+static const uint8_t na_vector[RUUVI_RAWV2_LEN] = {
+	0x99, 0x04, 0x05, 0x80, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xCB, 0xB8, 0x33, 0x4C, 0x88, 0x4F,
+};
+
+static ruuvi_rawv2_t valid_values(void)
+{
+	ruuvi_rawv2_t data = {
+		.temperature = 4860,
+		.humidity = 21396,
+		.pressure = 100044,
+		.acceleration = {4, -4, 1036},
+		.battery_voltage = 2977,
+		.tx_power = 4,
+		.movement_counter = 66,
+		.sequence_number = 205,
+	};
+	memcpy(data.mac, mac, RUUVI_MAC_LEN);
+	return data;
+}
+
+static uint16_t field_u16(const uint8_t *buf, size_t offset)
+{
+	return ((uint16_t)buf[offset] << 8) | buf[offset + 1];
+}
+
+static uint16_t encode_power_info(uint16_t battery_voltage, int8_t tx_power)
+{
+	ruuvi_rawv2_t data;
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	ruuvi_rawv2_init(&data);
+	data.battery_voltage = battery_voltage;
+	data.tx_power = tx_power;
+	zassert_equal(ruuvi_rawv2_encode(&data, buf, sizeof(buf)), RUUVI_RAWV2_LEN);
+	return field_u16(buf, OFFSET_POWER_INFO);
+}
+
+static void assert_rawv2_equal(const ruuvi_rawv2_t *a, const ruuvi_rawv2_t *b)
+{
+	zassert_equal(a->temperature, b->temperature);
+	zassert_equal(a->humidity, b->humidity);
+	zassert_equal(a->pressure, b->pressure);
+	for (int i = 0; i < 3; i++) {
+		zassert_equal(a->acceleration[i], b->acceleration[i], "axis %d", i);
+	}
+	zassert_equal(a->battery_voltage, b->battery_voltage);
+	zassert_equal(a->tx_power, b->tx_power);
+	zassert_equal(a->movement_counter, b->movement_counter);
+	zassert_equal(a->sequence_number, b->sequence_number);
+	zassert_mem_equal(a->mac, b->mac, RUUVI_MAC_LEN);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_encode_valid_vector)
+{
+	ruuvi_rawv2_t data = valid_values();
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	zassert_equal(ruuvi_rawv2_encode(&data, buf, sizeof(buf)), RUUVI_RAWV2_LEN);
+	zassert_mem_equal(buf, valid_vector, RUUVI_RAWV2_LEN);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_decode_valid_vector)
+{
+	ruuvi_rawv2_t expected = valid_values();
+	ruuvi_rawv2_t data;
+
+	zassert_ok(ruuvi_rawv2_decode(valid_vector, sizeof(valid_vector), &data));
+	assert_rawv2_equal(&data, &expected);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_min_vector)
+{
+	ruuvi_rawv2_t data = {
+		.temperature = -32767,
+		.humidity = 0,
+		.pressure = 50000,
+		.acceleration = {-32767, -32767, -32767},
+		.battery_voltage = 1600,
+		.tx_power = -40,
+		.movement_counter = 0,
+		.sequence_number = 0,
+	};
+	ruuvi_rawv2_t decoded;
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	memcpy(data.mac, mac, RUUVI_MAC_LEN);
+	zassert_equal(ruuvi_rawv2_encode(&data, buf, sizeof(buf)), RUUVI_RAWV2_LEN);
+	zassert_mem_equal(buf, min_vector, RUUVI_RAWV2_LEN);
+	zassert_ok(ruuvi_rawv2_decode(buf, sizeof(buf), &decoded));
+	assert_rawv2_equal(&decoded, &data);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_round_trip)
+{
+	ruuvi_rawv2_t data = valid_values();
+	ruuvi_rawv2_t decoded;
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	// every representable temperature step, with the other fields varied alongside
+	for (int32_t temperature = -32767; temperature <= 32767; temperature += 97) {
+		data.temperature = temperature;
+		data.humidity = (uint32_t)(temperature + 32767) % (RUUVI_RAWV2_HUMIDITY_MAX + 1);
+		data.sequence_number = (uint16_t)(temperature + 32767) % (RUUVI_RAWV2_SEQUENCE_MAX + 1);
+		data.acceleration[0] = -temperature;
+		zassert_equal(ruuvi_rawv2_encode(&data, buf, sizeof(buf)), RUUVI_RAWV2_LEN);
+		zassert_ok(ruuvi_rawv2_decode(buf, sizeof(buf), &decoded));
+		assert_rawv2_equal(&decoded, &data);
+	}
+}
+
+ZTEST(ruuvi_codec, test_rawv2_clamping)
+{
+	ruuvi_rawv2_t data = valid_values();
+	ruuvi_rawv2_t decoded;
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	data.temperature = 40000;
+	data.humidity = 50000;
+	data.pressure = 200000;
+	data.acceleration[0] = 40000;
+	data.acceleration[1] = -40000;
+	data.acceleration[2] = INT32_MIN + 1;
+	ruuvi_rawv2_encode(&data, buf, sizeof(buf));
+	zassert_equal(field_u16(buf, OFFSET_TEMPERATURE), 0x7FFF);
+	zassert_equal(field_u16(buf, OFFSET_HUMIDITY), RUUVI_RAWV2_HUMIDITY_MAX);
+	zassert_equal(field_u16(buf, OFFSET_PRESSURE), 0xFFFE);
+	zassert_equal(field_u16(buf, OFFSET_ACCELERATION), 0x7FFF);
+	// the minimum is -32767, -32768 is "not available"
+	zassert_equal(field_u16(buf, OFFSET_ACCELERATION + 2), 0x8001);
+	zassert_equal(field_u16(buf, OFFSET_ACCELERATION + 4), 0x8001);
+
+	zassert_ok(ruuvi_rawv2_decode(buf, sizeof(buf), &decoded));
+	zassert_equal(decoded.temperature, RUUVI_RAWV2_TEMPERATURE_MAX);
+	zassert_equal(decoded.humidity, RUUVI_RAWV2_HUMIDITY_MAX);
+	zassert_equal(decoded.pressure, RUUVI_RAWV2_PRESSURE_MAX);
+
+	data.temperature = -40000;
+	data.pressure = 10000;
+	ruuvi_rawv2_encode(&data, buf, sizeof(buf));
+	zassert_equal(field_u16(buf, OFFSET_TEMPERATURE), 0x8001);
+	zassert_equal(field_u16(buf, OFFSET_PRESSURE), 0x0000);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_not_available)
+{
+	ruuvi_rawv2_t data;
+	ruuvi_rawv2_t decoded;
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	ruuvi_rawv2_init(&data);
+	memcpy(data.mac, mac, RUUVI_MAC_LEN);
+	zassert_equal(ruuvi_rawv2_encode(&data, buf, sizeof(buf)), RUUVI_RAWV2_LEN);
+	zassert_mem_equal(buf, na_vector, RUUVI_RAWV2_LEN);
+
+	zassert_ok(ruuvi_rawv2_decode(buf, sizeof(buf), &decoded));
+	zassert_equal(decoded.temperature, RUUVI_TEMPERATURE_NA);
+	zassert_equal(decoded.humidity, RUUVI_HUMIDITY_NA);
+	zassert_equal(decoded.pressure, RUUVI_PRESSURE_NA);
+	for (int i = 0; i < 3; i++) {
+		zassert_equal(decoded.acceleration[i], RUUVI_ACCELERATION_NA, "axis %d", i);
+	}
+	zassert_equal(decoded.battery_voltage, RUUVI_BATTERY_NA);
+	zassert_equal(decoded.tx_power, RUUVI_TX_POWER_NA);
+	zassert_equal(decoded.movement_counter, RUUVI_MOVEMENT_NA);
+	zassert_equal(decoded.sequence_number, RUUVI_SEQUENCE_NA);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_power_info)
+{
+	// 3.3V (USB powered dongle) at 0dBm
+	zassert_equal(encode_power_info(3300, 0), 0xD494);
+	// each part is "not available" on its own
+	zassert_equal(encode_power_info(RUUVI_BATTERY_NA, 0), 0xFFF4);
+	zassert_equal(encode_power_info(3300, RUUVI_TX_POWER_NA), 0xD49F);
+	// limits of both parts
+	zassert_equal(encode_power_info(1600, -40), 0x0000);
+	zassert_equal(encode_power_info(3646, 20), (2046 << 5) | 30);
+	zassert_equal(encode_power_info(1000, -60), 0x0000);
+	zassert_equal(encode_power_info(5000, 30), (2046 << 5) | 30);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_tx_power_steps)
+{
+	ruuvi_rawv2_t data = valid_values();
+	ruuvi_rawv2_t decoded;
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	// odd levels are rounded down to the 2dBm grid
+	data.tx_power = 3;
+	ruuvi_rawv2_encode(&data, buf, sizeof(buf));
+	zassert_ok(ruuvi_rawv2_decode(buf, sizeof(buf), &decoded));
+	zassert_equal(decoded.tx_power, 2);
+
+	data.tx_power = -39;
+	ruuvi_rawv2_encode(&data, buf, sizeof(buf));
+	zassert_ok(ruuvi_rawv2_decode(buf, sizeof(buf), &decoded));
+	zassert_equal(decoded.tx_power, -40);
+}
+
+ZTEST(ruuvi_codec, test_rawv2_invalid_input)
+{
+	ruuvi_rawv2_t data = valid_values();
+	uint8_t buf[RUUVI_RAWV2_LEN];
+
+	zassert_equal(ruuvi_rawv2_encode(&data, buf, sizeof(buf) - 1), -ENOBUFS);
+	zassert_equal(ruuvi_rawv2_decode(valid_vector, sizeof(valid_vector) - 1, &data), -EINVAL);
+
+	memcpy(buf, valid_vector, sizeof(buf));
+	buf[0] = 0x98;
+	zassert_equal(ruuvi_rawv2_decode(buf, sizeof(buf), &data), -EINVAL);
+
+	memcpy(buf, valid_vector, sizeof(buf));
+	buf[2] = RUUVI_E1_FORMAT;
+	zassert_equal(ruuvi_rawv2_decode(buf, sizeof(buf), &data), -EINVAL);
+}
+
+ZTEST(ruuvi_codec, test_e1_index_packing)
+{
+	ruuvi_e1_t data;
+	uint8_t buf[RUUVI_E1_LEN];
+
+	// 9 bit VOC and NOx indexes, the least significant bits are stored in the flags
+	ruuvi_e1_init(&data);
+	data.voc = 0x155;
+	data.nox = 0x0AA;
+	data.flags = RUUVI_E1_FLAG_CALIBRATION;
+	zassert_equal(ruuvi_e1_encode(&data, buf, sizeof(buf)), RUUVI_E1_LEN);
+	zassert_equal(buf[19], 0xAA);
+	zassert_equal(buf[20], 0x55);
+	zassert_equal(buf[30], RUUVI_E1_FLAG_CALIBRATION | 0x40);
+
+	// out of range indexes are clamped, "not available" sets all 9 bits
+	data.voc = 1000;
+	data.nox = RUUVI_NOX_NA;
+	ruuvi_e1_encode(&data, buf, sizeof(buf));
+	zassert_equal(buf[19], 500 >> 1);
+	zassert_equal(buf[20], 0xFF);
+	zassert_equal(buf[30], RUUVI_E1_FLAG_CALIBRATION | 0x80);
+}
+
+ZTEST(ruuvi_codec, test_f8_round_trip)
+{
+	ruuvi_rawv2_t data = valid_values();
+	ruuvi_rawv2_t decoded;
+	uint8_t buf[RUUVI_F8_LEN];
+	uint32_t counter;
+
+	zassert_equal(ruuvi_f8_encode(&data, 0x12345678, buf, sizeof(buf)), RUUVI_F8_LEN);
+	zassert_ok(ruuvi_f8_decode(buf, sizeof(buf), &decoded, &counter));
+	zassert_equal(counter, 0x12345678);
+	// the acceleration is not part of the format
+	for (int i = 0; i < 3; i++) {
+		data.acceleration[i] = RUUVI_ACCELERATION_NA;
+	}
+	assert_rawv2_equal(&decoded, &data);
+
+	// a payload decrypted with the wrong key fails its CRC
+	buf[RUUVI_F8_CIPHER_OFFSET] ^= 0x01;
+	zassert_equal(ruuvi_f8_decode(buf, sizeof(buf), &decoded, &counter), -EBADMSG);
+}
+
+ZTEST_SUITE(ruuvi_codec, NULL, NULL, NULL, NULL, NULL);